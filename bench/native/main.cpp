@@ -0,0 +1,189 @@
+/**
+ * @file main.cpp
+ * @brief Host microbenchmarks of the streaming pipeline: FIFO, synthesis and the wire formats.
+ *
+ * Built by the native PlatformIO environment against the firmware's own sources:
+ *
+ *     pio run -e native && .pio/build/native/program
+ *
+ * Absolute numbers are for the host, not the ESP32; compare the rows with each other, and the
+ * same row before and after a change.
+ */
+
+#include <Arduino.h>
+#include <ArduinoJson.h>
+#include <stdio.h>
+#include "SpscRing.h"
+#include "WaveformSynth.h"
+#include "StreamFormat.h"
+
+#ifndef BENCH_ITERATIONS
+#define BENCH_ITERATIONS 2000000 ///< Samples pushed through each benchmark.
+#endif
+
+static volatile uint32_t sink; ///< Keeps the compiler from discarding the benchmarked work.
+
+/**
+ * @brief Nanoseconds elapsed since @p start.
+ */
+static double elapsedNs(std::chrono::steady_clock::time_point start)
+{
+    return std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - start).count();
+}
+
+/**
+ * @brief Prints one result row.
+ *
+ * @param name What was measured.
+ * @param ns Total time in nanoseconds.
+ * @param samples Frames the time is spread over.
+ * @param bytes Bytes produced, 0 when not applicable.
+ */
+static void report(const char *name, double ns, uint32_t samples, size_t bytes)
+{
+    if (bytes)
+    {
+        printf("%-34s %9.1f ns/frame %7.2f bytes/frame\n", name, ns / samples, (double)bytes / samples);
+    }
+    else
+    {
+        printf("%-34s %9.1f ns/frame\n", name, ns / samples);
+    }
+}
+
+/**
+ * @brief Fills @p frames with a few beats of every channel.
+ */
+static void makeFrames(SampleFrame *frames, size_t count)
+{
+    WaveformSynth synth[CHANNEL_COUNT];
+    synth[CHANNEL_ECG].render(WAVEFORM_EKG, &frames[0].ch[CHANNEL_ECG], count, CHANNEL_COUNT);
+    synth[CHANNEL_PLETH].render(WAVEFORM_PLETH, &frames[0].ch[CHANNEL_PLETH], count, CHANNEL_COUNT);
+    synth[CHANNEL_RESP].render(WAVEFORM_RESP, &frames[0].ch[CHANNEL_RESP], count, CHANNEL_COUNT);
+}
+
+static SpscRing<StampedFrame, 256> ring;
+
+static void benchFifo()
+{
+    StampedFrame frame = {};
+    auto start = std::chrono::steady_clock::now();
+    for (uint32_t i = 0; i < BENCH_ITERATIONS; i++)
+    {
+        frame.stampUs = i;
+        ring.enqueue(frame);
+        ring.dequeue(frame);
+    }
+    sink = frame.stampUs;
+    report("fifo enqueue+dequeue", elapsedNs(start), BENCH_ITERATIONS, 0);
+
+    StampedFrame out[NOTIFY_BATCH_MAX];
+    start = std::chrono::steady_clock::now();
+    for (uint32_t i = 0; i < BENCH_ITERATIONS; i += NOTIFY_BATCH_MAX)
+    {
+        for (size_t n = 0; n < NOTIFY_BATCH_MAX; n++)
+        {
+            frame.stampUs = i + n;
+            ring.enqueue(frame);
+        }
+        sink = ring.dequeue(out, NOTIFY_BATCH_MAX);
+    }
+    report("fifo enqueue, batch dequeue", elapsedNs(start), BENCH_ITERATIONS, 0);
+}
+
+static void benchSynth()
+{
+    static const struct
+    {
+        const char *name;
+        Interpolation interpolation;
+    } modes[] = { { "synth render, linear", INTERP_LINEAR }, { "synth render, cubic", INTERP_CUBIC } };
+
+    SampleFrame block[8];
+    for (const auto &mode : modes)
+    {
+        WaveformSynth synth[CHANNEL_COUNT];
+        for (WaveformSynth &s : synth)
+        {
+            s.setInterpolation(mode.interpolation);
+        }
+        auto start = std::chrono::steady_clock::now();
+        for (uint32_t i = 0; i < BENCH_ITERATIONS; i += 8)
+        {
+            synth[CHANNEL_ECG].render(WAVEFORM_EKG, &block[0].ch[CHANNEL_ECG], 8, CHANNEL_COUNT);
+            synth[CHANNEL_PLETH].render(WAVEFORM_PLETH, &block[0].ch[CHANNEL_PLETH], 8, CHANNEL_COUNT);
+            synth[CHANNEL_RESP].render(WAVEFORM_RESP, &block[0].ch[CHANNEL_RESP], 8, CHANNEL_COUNT);
+            sink = block[7].ch[CHANNEL_ECG];
+        }
+        report(mode.name, elapsedNs(start), BENCH_ITERATIONS, 0);
+    }
+}
+
+static void benchFormats()
+{
+    static SampleFrame frames[1024];
+    makeFrames(frames, 1024);
+    static char record[SSE_RECORD_MAX];
+    static uint8_t binary[sizeof(StreamFrameHeader) + NOTIFY_BATCH_MAX * sizeof(SampleFrame)];
+    size_t bytes = 0;
+
+    // The original path: one ArduinoJson document and one event per sample, ECG only
+    auto start = std::chrono::steady_clock::now();
+    for (uint32_t i = 0; i < BENCH_ITERATIONS; i++)
+    {
+        JsonDocument doc;
+        doc["val"] = frames[i & 1023].ch[CHANNEL_ECG];
+        char *p = beginRecord(record, "value", i);
+        p += serializeJson(doc, p, record + sizeof(record) - p);
+        bytes += endRecord(p) - record;
+    }
+    report("sse \"value\", ArduinoJson, ECG", elapsedNs(start), BENCH_ITERATIONS, bytes);
+
+    bytes = 0;
+    start = std::chrono::steady_clock::now();
+    for (uint32_t i = 0; i < BENCH_ITERATIONS; i++)
+    {
+        char *p = beginRecord(record, "value", i);
+        p = appendString(p, "{\"val\":");
+        p = appendUInt(p, frames[i & 1023].ch[CHANNEL_ECG]);
+        bytes += endRecord(appendString(p, "}")) - record;
+    }
+    report("sse \"value\", in place, ECG", elapsedNs(start), BENCH_ITERATIONS, bytes);
+
+    bytes = 0;
+    start = std::chrono::steady_clock::now();
+    for (uint32_t i = 0; i < BENCH_ITERATIONS; i += NOTIFY_BATCH_MAX)
+    {
+        char *p = beginRecord(record, "values", i);
+        bytes += endRecord(appendValues(p, &frames[i & (1023 & ~(NOTIFY_BATCH_MAX - 1))], NOTIFY_BATCH_MAX, 1)) - record;
+    }
+    report("sse \"values\" batch, all channels", elapsedNs(start), BENCH_ITERATIONS, bytes);
+
+    bytes = 0;
+    start = std::chrono::steady_clock::now();
+    for (uint32_t i = 0; i < BENCH_ITERATIONS; i += NOTIFY_BATCH_MAX)
+    {
+        bytes += writeStreamFrame(binary, &frames[i & (1023 & ~(NOTIFY_BATCH_MAX - 1))], NOTIFY_BATCH_MAX, i, SYNTH_SAMPLE_RATE, 0, 0, 0);
+        sink = binary[sizeof(StreamFrameHeader)];
+    }
+    report("ws binary batch, all channels", elapsedNs(start), BENCH_ITERATIONS, bytes);
+
+    static uint8_t delta[sizeof(StreamFrameHeader) + STREAM_DELTA_PAYLOAD_MAX(NOTIFY_BATCH_MAX)];
+    bytes = 0;
+    start = std::chrono::steady_clock::now();
+    for (uint32_t i = 0; i < BENCH_ITERATIONS; i += NOTIFY_BATCH_MAX)
+    {
+        bytes += writeStreamFrameDelta(delta, &frames[i & (1023 & ~(NOTIFY_BATCH_MAX - 1))], NOTIFY_BATCH_MAX, i, SYNTH_SAMPLE_RATE, 0, 0, 0);
+        sink = delta[sizeof(StreamFrameHeader)];
+    }
+    report("ws delta batch, all channels", elapsedNs(start), BENCH_ITERATIONS, bytes);
+}
+
+int main()
+{
+    printf("%u frames per benchmark, batches of %u\n\n", (unsigned)BENCH_ITERATIONS, (unsigned)NOTIFY_BATCH_MAX);
+    benchFifo();
+    benchSynth();
+    benchFormats();
+    return 0;
+}
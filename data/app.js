@@ -1,6 +1,11 @@
 /**
  * @file app.js
- * @brief Initializes and updates a SciChart chart with real-time data via Server-Sent Events.
+ * @brief Initializes and updates a chart with real-time data via WebSocket or Server-Sent Events.
+ *
+ * The chart is drawn with SciChart when it can be fetched quickly, otherwise with a small built-in
+ * canvas renderer, so the trace starts without an internet connection. Add ?renderer=canvas or
+ * ?renderer=scichart to the page URL to force one of them. Received samples wait in a ring buffer and the sweep
+ * draws them once per animation frame at the sample rate, so network bursts do not show in the trace.
  */
 
 /** 
@@ -10,43 +15,642 @@
 let xValue = 0;
 
 /** 
- * @var {object} dataSeries 
- * @brief Holds the data series for the chart. Initialized by initSciChart function.
+ * @var {object[]} dataSeries 
+ * @brief Holds one data series per channel (ECG, pleth, resp): SciChart XyDataSeries or SweepTrace. Set by initChart.
  */
-let dataSeries;
+let dataSeries = [];
+
+/** 
+ * @var {?function(): void} drawChart 
+ * @brief Repaints the built-in renderer after new points were appended, null for SciChart, which repaints itself.
+ */
+let drawChart = null;
+
+/** 
+ * @var {?number} nextSeq 
+ * @brief Sequence number of the next frame the chart needs, null until the first one arrives.
+ */
+let nextSeq = null;
 
 /** 
  * @var {number} POINTS_LOOP 
  * @brief Defines the loop point for the x-axis value. When reached, xValue resets to 0.
  */
-const POINTS_LOOP = 256;
+const POINTS_LOOP = 1024; // About four seconds of trace at the 250 Hz synthesis rate
+
+/** 
+ * @var {number} SAMPLE_RATE 
+ * @brief Samples per second of every channel, SYNTH_SAMPLE_RATE on the device. Paces the sweep.
+ */
+const SAMPLE_RATE = 250;
+
+/** 
+ * @var {number} RING_CAPACITY 
+ * @brief Frames the sample ring holds, a power of two; about 16 s at SAMPLE_RATE.
+ */
+const RING_CAPACITY = 4096;
+
+/** 
+ * @var {number} PLAYBACK_DELAY_MS 
+ * @brief How far the sweep runs behind the newest sample, enough to ride out a late batch.
+ */
+const PLAYBACK_DELAY_MS = 200;
+
+/** 
+ * @var {number} PLAYBACK_MAX_LAG_MS 
+ * @brief Further behind than this, after a catch-up frame or a hidden tab, the sweep jumps ahead instead.
+ */
+const PLAYBACK_MAX_LAG_MS = 1000;
+
+/** 
+ * @var {number} PLAYBACK_TRIM 
+ * @brief Most the sweep speeds up or slows down to hold PLAYBACK_DELAY_MS against clock drift.
+ */
+const PLAYBACK_TRIM = 0.05;
+
+/** 
+ * @var {number} SWEEP_GAP 
+ * @brief Number of points cleared ahead of the sweep cursor.
+ */
+const SWEEP_GAP = 64;
+
+/** 
+ * @var {number} Y_RANGE 
+ * @brief Top of the y-axis; the channel bands stack up to here.
+ */
+const Y_RANGE = 768;
+
+/** 
+ * @var {string} SCICHART_URL 
+ * @brief Where SciChart is loaded from. It is too large for the device's filesystem.
+ */
+const SCICHART_URL = "https://cdn.jsdelivr.net/npm/scichart@3.3.560/index.min.js";
+
+/** 
+ * @var {number} SCICHART_DEADLINE_MS 
+ * @brief Time SciChart gets to load before the built-in renderer takes over.
+ */
+const SCICHART_DEADLINE_MS = 800;
+
+/** 
+ * @var {string} RENDERER 
+ * @brief "auto", "canvas" or "scichart", from the ?renderer= query parameter.
+ */
+const RENDERER = new URLSearchParams(window.location.search).get("renderer") || "auto";
+
+/** 
+ * @var {number} FRAME_HEADER_SIZE 
+ * @brief Size in bytes of the StreamFrameHeader that precedes the samples in each /ws frame.
+ */
+const FRAME_HEADER_SIZE = 20;
+
+/** 
+ * @var {number} LATENCY_ECHO_INTERVAL_MS 
+ * @brief How often a frame's timestamps are echoed back to the device for latency tracing.
+ */
+const LATENCY_ECHO_INTERVAL_MS = 1000;
+
+/** 
+ * @var {number} LATENCY_ECHO_TYPE 
+ * @brief First byte of a latency echo, matches LATENCY_ECHO_TYPE in LatencyTrace.h.
+ */
+const LATENCY_ECHO_TYPE = 1;
+
+/** 
+ * @var {number} STREAM_FLAG_REPLAY 
+ * @brief StreamFrameHeader flag of a catch-up frame sent from the device's history.
+ */
+const STREAM_FLAG_REPLAY = 0x04;
+
+/** 
+ * @var {number} STREAM_ENCODING_DELTA 
+ * @brief StreamFrameHeader encoding of zigzag varint deltas with zero runs, matches StreamFormat.h.
+ */
+const STREAM_ENCODING_DELTA = 1;
+
+/** 
+ * @var {number} STREAM_ENCODING 
+ * @brief Encoding asked for in the resume message; ?encoding=raw turns the delta encoding off.
+ */
+const STREAM_ENCODING = new URLSearchParams(window.location.search).get("encoding") === "raw" ? 0 : STREAM_ENCODING_DELTA;
+
+/** 
+ * @var {number} STREAM_RESUME_TYPE 
+ * @brief First byte of the message asking for a catch-up frame, matches StreamFormat.h.
+ */
+const STREAM_RESUME_TYPE = 2;
+
+/** 
+ * @var {number} STREAM_RESUME_HAS_SEQ 
+ * @brief Resume flag telling the device the message carries nextSeq.
+ */
+const STREAM_RESUME_HAS_SEQ = 0x01;
+
+/** 
+ * @var {number} REPLAY_WAIT_MS 
+ * @brief How long live frames are held back waiting for the catch-up frame.
+ */
+const REPLAY_WAIT_MS = 1000;
+
+/** 
+ * @var {number} SEQ_RESET_DISTANCE 
+ * @brief Frames further behind nextSeq than this mean the device restarted, not a repeat.
+ */
+const SEQ_RESET_DISTANCE = 4096;
+
+/** 
+ * @var {object[]} CHANNELS 
+ * @brief Display settings per channel, in wire order. Each trace gets its own band of the y-axis.
+ */
+const CHANNELS = [
+    { name: "ECG", offset: 512, stroke: "#f48420" },
+    { name: "Pleth", offset: 256, stroke: "#29b6f6" },
+    { name: "Resp", offset: 0, stroke: "#ffee58" },
+];
 
 /** 
  * @var {EventSource} evtSource 
- * @brief Establishes a connection to the server for receiving real-time data updates via Server-Sent Events.
+ * @brief Server-Sent Events connection, only opened when the WebSocket stream is unavailable.
+ */
+let evtSource = null;
+
+/**
+ * @class SampleRing
+ * @brief Decoded samples waiting to be drawn, one typed-array ring per channel, already offset into the channel's band.
+ *
+ * Positions count frames since the page loaded. The receive path writes at one end as fast as the network
+ * delivers; the sweep reads from the other end once per animation frame. When it is full, the oldest frames
+ * are dropped.
+ */
+class SampleRing {
+    /**
+     * @param {number[]} offsets Y offset of each channel.
+     * @param {number} capacity Frames held, a power of two.
+     */
+    constructor(offsets, capacity) {
+        this.offsets = offsets;
+        this.mask = capacity - 1;
+        this.channels = offsets.map(() => new Float64Array(capacity));
+        this.written = 0;
+        this.read = 0;
+    }
+
+    /**
+     * @brief Writes a block of sample-aligned channels.
+     * @param {ArrayLike<number>[]} channels One array of samples per channel, oldest first, all of the same length.
+     * Channels missing from the block are written as NaN, which the chart leaves blank.
+     * @param {number} ticksPerValue Sample periods each value stands for. Decimated values are held that
+     * many frames so the sweep speed does not change.
+     */
+    push(channels, ticksPerValue) {
+        const count = channels[0].length * ticksPerValue;
+        for (let c = 0; c < this.channels.length; c++) {
+            const ring = this.channels[c];
+            const source = channels[c];
+            const offset = this.offsets[c];
+            for (let i = 0; i < count; i++) {
+                ring[(this.written + i) & this.mask] = source ? source[Math.floor(i / ticksPerValue)] + offset : NaN;
+            }
+        }
+        this.written += count;
+        this.read = Math.max(this.read, this.written - this.mask - 1);
+    }
+
+    /**
+     * @brief Moves the oldest frames out of the ring.
+     * @param {number} count Frames to take, at most the number waiting.
+     * @param {Float64Array[]} out One array per channel, at least @p count long, filled from index 0.
+     */
+    take(count, out) {
+        for (let c = 0; c < this.channels.length; c++) {
+            const ring = this.channels[c];
+            const target = out[c];
+            for (let i = 0; i < count; i++) {
+                target[i] = ring[(this.read + i) & this.mask];
+            }
+        }
+        this.read += count;
+    }
+
+    /**
+     * @brief Drops the oldest frames without reading them.
+     * @param {number} count Frames to drop, at most the number waiting.
+     */
+    skip(count) {
+        this.read += count;
+    }
+}
+
+/** 
+ * @var {SampleRing} ring 
+ * @brief Everything received and not drawn yet, including what arrived before the chart was ready.
+ */
+const ring = new SampleRing(CHANNELS.map(channel => channel.offset), RING_CAPACITY);
+
+/**
+ * @brief Queues a block of sample-aligned channels for the sweep.
+ * @param {ArrayLike<number>[]} channels One array of samples per channel, oldest first, all of the same length.
+ * @param {number} [ticksPerValue=1] Sample periods each value stands for.
+ */
+function queueChannels(channels, ticksPerValue = 1) {
+    if (channels.length === 0 || channels[0].length === 0) {
+        return;
+    }
+    ring.push(channels, ticksPerValue);
+}
+
+/**
+ * @brief Works out how much of a block the chart already has, and moves nextSeq past the block.
+ * 
+ * Catch-up frames overlap the live stream they are sent next to, so repeated frames are expected.
+ * A block starting past nextSeq is a gap and is drawn as it is.
+ * @param {number} seq Sequence number of the block's first frame.
+ * @param {number} frames Frames the block stands for.
+ * @return {number} How many leading frames are already drawn; all of them for a repeat.
  */
-const evtSource = new EventSource('/events');
+function claimFrames(seq, frames) {
+    const behind = nextSeq === null ? 0 : (nextSeq - seq) >>> 0;
+    if (behind >= frames && behind < SEQ_RESET_DISTANCE) {
+        return frames;
+    }
+    nextSeq = (seq + frames) >>> 0;
+    return behind < SEQ_RESET_DISTANCE ? behind : 0;
+}
 
 /**
- * @brief Listens for "value" events from the server and updates the chart with received data.
+ * @brief Appends a block of channels that starts at a known sequence number, skipping any repeated part.
+ * @param {number} seq Sequence number of the first frame.
+ * @param {ArrayLike<number>[]} channels One array of samples per channel.
+ * @param {number} [ticksPerValue=1] Sample periods each value stands for.
  */
-evtSource.addEventListener("value", function(event) {
-    const data = JSON.parse(event.data);
-    if (dataSeries) {
-        if (xValue >= POINTS_LOOP) {
-            xValue = 0; // Reset xValue for looping effect
+function appendSequenced(seq, channels, ticksPerValue = 1) {
+    const count = channels.length ? channels[0].length : 0;
+    const skip = Math.ceil(claimFrames(seq, count * ticksPerValue) / ticksPerValue);
+    if (skip < count) {
+        queueChannels(skip ? channels.map(channel => channel.slice(skip)) : channels, ticksPerValue);
+    }
+}
+
+/**
+ * @brief Splits an interleaved block of frames into one array per channel.
+ * @param {Uint8Array} samples Frames laid out as ch0, ch1, ..., ch0, ch1, ...
+ * @param {number} channelCount Number of channels in each frame.
+ * @return {Uint8Array[]} One array per channel.
+ */
+function deinterleave(samples, channelCount) {
+    const count = Math.floor(samples.length / channelCount);
+    const channels = [];
+    for (let c = 0; c < channelCount; c++) {
+        const channel = new Uint8Array(count);
+        for (let i = 0; i < count; i++) {
+            channel[i] = samples[i * channelCount + c];
         }
-        dataSeries.append(xValue, data.val); // Append new data point to the series
-        xValue += 1; // Increment xValue for the next data point
+        channels.push(channel);
     }
-}, false);
+    return channels;
+}
+
+/**
+ * @brief Decodes a STREAM_ENCODING_DELTA payload, see StreamFrameHeader in StreamFormat.h.
+ * @param {Uint8Array} bytes The payload after the header.
+ * @param {number} count Samples per channel.
+ * @param {number} channelCount Number of channels, encoded one after the other.
+ * @return {?Uint8Array[]} One array per channel, or null if the payload is cut short.
+ */
+function decodeDelta(bytes, count, channelCount) {
+    let pos = 0;
+    const readVarint = function() {
+        let value = 0;
+        for (let shift = 0; pos < bytes.length; shift += 7) {
+            const byte = bytes[pos++];
+            value |= (byte & 0x7F) << shift;
+            if (!(byte & 0x80)) {
+                return value >>> 0;
+            }
+        }
+        return -1;
+    };
+
+    const channels = [];
+    for (let c = 0; c < channelCount; c++) {
+        const channel = new Uint8Array(count);
+        let previous = 0;
+        for (let i = 0; i < count;) {
+            const zigzag = readVarint();
+            if (zigzag < 0) {
+                return null;
+            }
+            const delta = (zigzag >>> 1) ^ -(zigzag & 1);
+            previous = (previous + delta) & 0xFF;
+            channel[i++] = previous;
+            if (delta === 0) {
+                const run = readVarint();
+                if (run < 0) {
+                    return null;
+                }
+                channel.fill(previous, i, i + run);
+                i += run;
+            }
+        }
+        channels.push(channel);
+    }
+    return channels;
+}
+
+/**
+ * @brief Opens the Server-Sent Events stream and listens for "value" and "values" events.
+ */
+function startEventSource() {
+    if (evtSource) {
+        return;
+    }
+    evtSource = new EventSource('/events');
+
+    // Event ids are the sequence number just past the event's last frame
+    evtSource.addEventListener("value", function(event) {
+        const data = JSON.parse(event.data);
+        appendSequenced((Number(event.lastEventId) - 1) >>> 0, [[data.val]]); // Single values only carry the ECG channel
+    }, false);
+
+    evtSource.addEventListener("values", function(event) {
+        const data = JSON.parse(event.data);
+        const ticksPerValue = data.dt || 1; // "dt" is only present while the server decimates for us
+        const frames = data.ch.length ? data.ch[0].length * ticksPerValue : 0;
+        appendSequenced((Number(event.lastEventId) - frames) >>> 0, data.ch, ticksPerValue);
+    }, false);
+}
+
+/** 
+ * @var {?object} pendingEcho 
+ * @brief Latency echo waiting for the sweep to draw its frame, with the ring position just past the frame.
+ */
+let pendingEcho = null;
+
+/**
+ * @brief Echoes a frame's device timestamps once the sweep has drawn the frame.
+ * 
+ * Reports how long after arrival that was in microseconds, playback delay included. The device works
+ * out the rest from its own clock, so the browser's clock never has to agree with it.
+ * @param {WebSocket} socket Stream the frame arrived on.
+ * @param {number} sentUs StreamFrameHeader sentUs of the frame.
+ * @param {number} genUs StreamFrameHeader genUs of the frame.
+ * @param {number} receivedAt performance.now() when the frame arrived; the frame must already be queued.
+ */
+function echoLatency(socket, sentUs, genUs, receivedAt) {
+    pendingEcho = { socket, sentUs, genUs, receivedAt, end: ring.written };
+}
+
+/**
+ * @brief Sends the pending latency echo if the sweep has reached its frame.
+ */
+function sendEcho() {
+    const pending = pendingEcho;
+    if (!pending || ring.read < pending.end) {
+        return;
+    }
+    pendingEcho = null;
+    if (pending.socket.readyState !== WebSocket.OPEN) {
+        return;
+    }
+    const echo = new DataView(new ArrayBuffer(16));
+    echo.setUint8(0, LATENCY_ECHO_TYPE);
+    echo.setUint32(4, pending.sentUs, true);
+    echo.setUint32(8, pending.genUs, true);
+    echo.setUint32(12, Math.round((performance.now() - pending.receivedAt) * 1000), true);
+    pending.socket.send(echo.buffer);
+}
+
+/**
+ * @brief Draws one binary /ws frame.
+ * @param {ArrayBuffer} buffer The frame, StreamFrameHeader first.
+ */
+function showFrame(buffer) {
+    const header = new DataView(buffer, 0, FRAME_HEADER_SIZE);
+    const channelCount = header.getUint8(10);
+    if (channelCount === 0) {
+        return;
+    }
+    const count = header.getUint16(8, true);
+    if (header.getUint8(11) === STREAM_ENCODING_DELTA) {
+        const channels = decodeDelta(new Uint8Array(buffer, FRAME_HEADER_SIZE), count, channelCount);
+        if (channels) {
+            appendSequenced(header.getUint32(4, true), channels);
+        }
+        return;
+    }
+    const length = Math.min(count * channelCount, buffer.byteLength - FRAME_HEADER_SIZE);
+    appendSequenced(header.getUint32(4, true), deinterleave(new Uint8Array(buffer, FRAME_HEADER_SIZE, length), channelCount));
+}
+
+/**
+ * @brief Opens the binary WebSocket stream, falling back to Server-Sent Events if it cannot connect.
+ * 
+ * Once connected it asks for a catch-up frame: what was missed since nextSeq, or the latest screen on
+ * a first connect. The same message picks the encoding of the live frames. Live frames are held back until it arrives so the trace is drawn in order.
+ */
+function startWebSocket() {
+    if (!("WebSocket" in window)) {
+        startEventSource();
+        return;
+    }
+    const socket = new WebSocket(`ws://${window.location.host}/ws`);
+    socket.binaryType = "arraybuffer";
+    let opened = false;
+    let lastEchoTime = 0;
+    let held = [];
+
+    const releaseHeld = function() {
+        if (held) {
+            held.forEach(showFrame);
+            held = null;
+        }
+    };
+
+    socket.onopen = function() {
+        opened = true;
+        const resume = new DataView(new ArrayBuffer(8));
+        resume.setUint8(0, STREAM_RESUME_TYPE);
+        resume.setUint8(1, nextSeq === null ? 0 : STREAM_RESUME_HAS_SEQ);
+        resume.setUint8(2, STREAM_ENCODING);
+        resume.setUint32(4, nextSeq === null ? 0 : nextSeq, true);
+        socket.send(resume.buffer);
+        setTimeout(releaseHeld, REPLAY_WAIT_MS); // Older firmware never answers
+    };
+
+    socket.onmessage = function(event) {
+        if (!(event.data instanceof ArrayBuffer) || event.data.byteLength < FRAME_HEADER_SIZE) {
+            return;
+        }
+        const header = new DataView(event.data, 0, FRAME_HEADER_SIZE);
+        if (header.getUint8(1) & STREAM_FLAG_REPLAY) {
+            showFrame(event.data);
+            releaseHeld();
+            return;
+        }
+        if (held) {
+            held.push(event.data);
+            return;
+        }
+        showFrame(event.data);
+
+        const receivedAt = performance.now();
+        if (receivedAt - lastEchoTime >= LATENCY_ECHO_INTERVAL_MS) {
+            lastEchoTime = receivedAt;
+            echoLatency(socket, header.getUint32(16, true), header.getUint32(12, true), receivedAt);
+        }
+    };
+
+    socket.onclose = function() {
+        if (opened) {
+            setTimeout(startWebSocket, 1000); // Lost an established stream, try again
+        } else {
+            startEventSource(); // The server or browser does not support /ws
+        }
+    };
+}
+
+startWebSocket();
+
+/**
+ * @brief Loads a script by adding a script element to the page.
+ * @param {string} url Script URL.
+ * @return {Promise<void>} Resolves once the script has run.
+ */
+function loadScript(url) {
+    return new Promise((resolve, reject) => {
+        const script = document.createElement("script");
+        script.src = url;
+        script.async = true;
+        script.onload = () => resolve();
+        script.onerror = () => reject(new Error(`failed to load ${url}`));
+        document.head.appendChild(script);
+    });
+}
+
+/**
+ * @brief Rejects if a promise does not settle in time.
+ * @param {Promise} promise The promise to wait for.
+ * @param {?number} ms Time limit in milliseconds, or null to wait forever.
+ * @return {Promise} Settles like @p promise, or rejects after @p ms.
+ */
+function withDeadline(promise, ms) {
+    if (ms === null) {
+        return promise;
+    }
+    return Promise.race([
+        promise,
+        new Promise((resolve, reject) => setTimeout(() => reject(new Error("timed out")), ms)),
+    ]);
+}
+
+/**
+ * @class SweepTrace
+ * @brief One channel of the built-in renderer. Takes the same appendRange() calls as an XyDataSeries.
+ */
+class SweepTrace {
+    /**
+     * @param {string} stroke Line colour.
+     */
+    constructor(stroke) {
+        this.stroke = stroke;
+        this.values = new Float32Array(POINTS_LOOP).fill(NaN);
+        this.cursor = -1;
+    }
+
+    /**
+     * @brief Writes points at their x positions and clears SWEEP_GAP points ahead of the newest one.
+     * @param {ArrayLike<number>} xValues X positions, 0 to POINTS_LOOP - 1.
+     * @param {ArrayLike<number>} yValues Y values.
+     */
+    appendRange(xValues, yValues) {
+        for (let i = 0; i < xValues.length; i++) {
+            const x = xValues[i] % POINTS_LOOP;
+            this.values[x] = yValues[i];
+            this.values[(x + SWEEP_GAP) % POINTS_LOOP] = NaN;
+            this.cursor = x;
+        }
+    }
+
+    /**
+     * @brief Writes a single point.
+     * @param {number} x X position.
+     * @param {number} y Y value.
+     */
+    append(x, y) {
+        this.appendRange([x], [y]);
+    }
+}
+
+/**
+ * @brief Sets up the built-in canvas renderer, which redraws every trace whenever the sweep has moved.
+ * @return {SweepTrace[]} One trace per channel.
+ */
+function initCanvasChart() {
+    const root = document.getElementById("scichart-root");
+    const canvas = document.createElement("canvas");
+    const scale = window.devicePixelRatio || 1;
+    canvas.width = root.clientWidth * scale;
+    canvas.height = root.clientHeight * scale;
+    canvas.style.width = "100%";
+    canvas.style.height = "100%";
+    root.appendChild(canvas);
+
+    const context = canvas.getContext("2d");
+    const traces = CHANNELS.map(channel => new SweepTrace(channel.stroke));
+    const xScale = canvas.width / POINTS_LOOP;
+    const yScale = canvas.height / Y_RANGE;
+
+    function draw() {
+        context.fillStyle = "#1c1c1e";
+        context.fillRect(0, 0, canvas.width, canvas.height);
+        context.lineWidth = 3 * scale;
+        context.lineJoin = "round";
+        for (const trace of traces) {
+            context.strokeStyle = trace.stroke;
+            context.beginPath();
+            let drawing = false;
+            for (let x = 0; x < POINTS_LOOP; x++) {
+                const y = trace.values[x];
+                if (Number.isNaN(y)) {
+                    drawing = false; // Sweep gap or not written yet
+                    continue;
+                }
+                const px = x * xScale;
+                const py = canvas.height - y * yScale;
+                if (drawing) {
+                    context.lineTo(px, py);
+                } else {
+                    context.moveTo(px, py);
+                    drawing = true;
+                }
+            }
+            context.stroke();
+
+            if (trace.cursor >= 0) {
+                context.fillStyle = "#fff";
+                context.beginPath();
+                context.arc(trace.cursor * xScale, canvas.height - trace.values[trace.cursor] * yScale, 5.5 * scale, 0, 2 * Math.PI);
+                context.fill();
+            }
+        }
+    }
+    draw();
+    drawChart = draw;
+    return traces;
+}
 
 /**
  * @brief Asynchronously initializes the SciChart environment, creates a chart, and configures its axes and series.
+ * @param {function(): boolean} isAbandoned Returns true once the caller has given up waiting.
+ * @return {Promise<object[]>} One data series per channel.
  */
-async function initSciChart() {
+async function initSciChart(isAbandoned) {
     const { SciChartSurface, NumericAxis, XyDataSeries, FastLineRenderableSeries, EllipsePointMarker } = window.SciChart;
     const { sciChartSurface, wasmContext } = await SciChartSurface.create("scichart-root");
+    if (isAbandoned()) {
+        sciChartSurface.delete(); // The built-in renderer already owns the page
+        throw new Error("too late");
+    }
     
     // Configure x-axis
     const xAxis = new NumericAxis(wasmContext, {
@@ -56,35 +660,127 @@ async function initSciChart() {
     
     // Configure y-axis
     const yAxis = new NumericAxis(wasmContext, {
-        visibleRange: new SciChart.NumberRange(0, 500),
+        visibleRange: new SciChart.NumberRange(0, Y_RANGE),
         isVisible: false, // Hides the y-axis for a cleaner look
     });
     
     sciChartSurface.xAxes.add(xAxis);
     sciChartSurface.yAxes.add(yAxis);
     
-    // Initialize data series with FIFO capacity
-    dataSeries = new XyDataSeries(wasmContext, {
-        fifoCapacity: POINTS_LOOP,
-        fifoSweeping: true,
-        fifoSweepingGap: 16
-    });
-    
-    // Create and configure a line series
-    const lineSeries = new FastLineRenderableSeries(wasmContext, {
-        dataSeries: dataSeries,
-        pointMarker: new EllipsePointMarker(wasmContext, {
-            width: 11,   
-            height: 11,
-            fill: "#fff",
-            lastPointOnly: true
-        }),
-        strokeThickness: 3,
-        stroke: "#f48420"
-    });
-    
-    sciChartSurface.renderableSeries.add(lineSeries);
+    const series = [];
+    for (const channel of CHANNELS) {
+        // Initialize data series with FIFO capacity
+        const xySeries = new XyDataSeries(wasmContext, {
+            dataSeriesName: channel.name,
+            fifoCapacity: POINTS_LOOP,
+            fifoSweeping: true,
+            fifoSweepingGap: SWEEP_GAP
+        });
+
+        // Create and configure a line series
+        const lineSeries = new FastLineRenderableSeries(wasmContext, {
+            dataSeries: xySeries,
+            pointMarker: new EllipsePointMarker(wasmContext, {
+                width: 11,   
+                height: 11,
+                fill: "#fff",
+                lastPointOnly: true
+            }),
+            strokeThickness: 3,
+            stroke: channel.stroke
+        });
+
+        sciChartSurface.renderableSeries.add(lineSeries);
+        series.push(xySeries);
+    }
+    return series;
+}
+
+/**
+ * @brief Picks a renderer and sets up the chart. Data arriving before this finishes waits in the ring.
+ */
+async function initChart() {
+    if (RENDERER !== "canvas") {
+        let abandoned = false;
+        const sciChart = loadScript(SCICHART_URL).then(() => initSciChart(() => abandoned));
+        try {
+            dataSeries = await withDeadline(sciChart, RENDERER === "scichart" ? null : SCICHART_DEADLINE_MS);
+            return;
+        } catch (error) {
+            abandoned = true;
+            sciChart.catch(() => {}); // A late failure is expected now
+            console.log(`SciChart unavailable (${error.message}), using the built-in renderer`);
+        }
+    }
+    dataSeries = initCanvasChart();
+}
+
+/**
+ * @brief Moves the sweep once per animation frame, paced by the sample rate rather than by when data arrives.
+ *
+ * The sweep trails the newest sample by PLAYBACK_DELAY_MS, so batches arriving in bursts still draw as an even
+ * trace, and every channel gets one appendRange() per animation frame whatever the network does. The pace is
+ * trimmed by up to PLAYBACK_TRIM to hold that delay as the browser's clock drifts from the device's. Running dry
+ * pauses the sweep until PLAYBACK_DELAY_MS has built up again; falling more than PLAYBACK_MAX_LAG_MS behind,
+ * after a catch-up frame or while the tab was hidden, jumps forward and draws the skipped part at once.
+ */
+function startPlayback() {
+    const target = PLAYBACK_DELAY_MS * SAMPLE_RATE / 1000;
+    const maxLag = PLAYBACK_MAX_LAG_MS * SAMPLE_RATE / 1000;
+    const xValues = new Float64Array(POINTS_LOOP);
+    const yValues = CHANNELS.map(() => new Float64Array(POINTS_LOOP));
+    let playhead = ring.read; // Ring position the sweep has reached, fractional
+    let playing = false;
+    let lastTime = null;
+
+    function tick(now) {
+        const elapsedMs = lastTime === null ? 0 : now - lastTime;
+        lastTime = now;
+        const buffered = ring.written - playhead;
+        if (!playing && buffered >= target) {
+            playing = true;
+        }
+        if (playing) {
+            const trim = Math.max(-1, Math.min(1, (buffered - target) / target));
+            playhead += elapsedMs * SAMPLE_RATE / 1000 * (1 + PLAYBACK_TRIM * trim);
+        }
+        if (ring.written - playhead > maxLag) {
+            playhead = ring.written - target;
+        }
+        if (playhead >= ring.written) {
+            playhead = ring.written; // Ran dry, wait for the delay to build up again
+            playing = false;
+        }
+        playhead = Math.max(playhead, ring.read);
+
+        let due = Math.floor(playhead) - ring.read;
+        if (due > POINTS_LOOP) {
+            ring.skip(due - POINTS_LOOP); // Overwritten by the rest before it was ever seen
+            xValue = (xValue + due - POINTS_LOOP) % POINTS_LOOP;
+            due = POINTS_LOOP;
+        }
+        if (due > 0) {
+            for (let i = 0; i < due; i++) {
+                if (xValue >= POINTS_LOOP) {
+                    xValue = 0; // Reset xValue for looping effect
+                }
+                xValues[i] = xValue;
+                xValue += 1;
+            }
+            ring.take(due, yValues);
+            const channelCount = Math.min(yValues.length, dataSeries.length);
+            for (let c = 0; c < channelCount; c++) {
+                dataSeries[c].appendRange(xValues.subarray(0, due), yValues[c].subarray(0, due)); // Append the whole frame's worth at once
+            }
+            if (drawChart) {
+                drawChart();
+            }
+            sendEcho();
+        }
+        window.requestAnimationFrame(tick);
+    }
+    window.requestAnimationFrame(tick);
 }
 
-// Call initSciChart to set up the chart
-initSciChart();
+// Call initChart to set up the chart, then start sweeping through whatever arrived while it loaded
+initChart().then(startPlayback);
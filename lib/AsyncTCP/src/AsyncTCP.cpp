@@ -42,6 +42,8 @@ typedef enum {
 typedef struct {
         lwip_event_t event;
         void *arg;
+        uint32_t seq;   //order in which events were queued, see _remove_events_with_arg
+        bool front;     //queued with _prepend_async_event
         union {
                 struct {
                         void * pcb;
@@ -79,6 +81,20 @@ typedef struct {
 static xQueueHandle _async_queue;
 static TaskHandle_t _async_service_task_handle = NULL;
 
+//Guards _last_event and _event_seq, which lwIP callbacks and the async_tcp task share
+static portMUX_TYPE _async_event_mux = portMUX_INITIALIZER_UNLOCKED;
+//Newest event appended to the queue that the async_tcp task has not picked up yet
+static lwip_event_packet_t * _last_event = NULL;
+static uint32_t _event_seq = 0;
+
+//Clients closed while events for them may still be queued; only touched by the async_tcp task
+typedef struct {
+        void * arg;
+        uint32_t seq;   //seq of the clear event, older events for arg are discarded
+} cleared_arg_t;
+static cleared_arg_t _cleared_args[CONFIG_LWIP_MAX_ACTIVE_TCP];
+static size_t _cleared_count = 0;
+
 
 SemaphoreHandle_t _slots_lock;
 const int _number_of_closed_slots = CONFIG_LWIP_MAX_ACTIVE_TCP;
@@ -95,7 +111,7 @@ static uint32_t _closed_index = []() {
 
 static inline bool _init_async_event_queue(){
     if(!_async_queue){
-        _async_queue = xQueueCreate(32, sizeof(lwip_event_packet_t *));
+        _async_queue = xQueueCreate(CONFIG_ASYNC_TCP_QUEUE_SIZE, sizeof(lwip_event_packet_t *));
         if(!_async_queue){
             return false;
         }
@@ -103,19 +119,104 @@ static inline bool _init_async_event_queue(){
     return true;
 }
 
-static inline bool _send_async_event(lwip_event_packet_t ** e){
-    return _async_queue && xQueueSend(_async_queue, e, portMAX_DELAY) == pdPASS;
+static inline bool _send_async_event(lwip_event_packet_t ** e, TickType_t wait = portMAX_DELAY){
+    if(!_async_queue){
+        return false;
+    }
+    portENTER_CRITICAL(&_async_event_mux);
+    (*e)->seq = _event_seq++;
+    (*e)->front = false;
+    _last_event = *e; //set before queueing so the async_tcp task can never free it first
+    portEXIT_CRITICAL(&_async_event_mux);
+    if(xQueueSend(_async_queue, e, wait) != pdPASS){
+        portENTER_CRITICAL(&_async_event_mux);
+        if(_last_event == *e){
+            _last_event = NULL;
+        }
+        portEXIT_CRITICAL(&_async_event_mux);
+        return false;
+    }
+    return true;
 }
 
 static inline bool _prepend_async_event(lwip_event_packet_t ** e){
-    return _async_queue && xQueueSendToFront(_async_queue, e, portMAX_DELAY) == pdPASS;
+    if(!_async_queue){
+        return false;
+    }
+    portENTER_CRITICAL(&_async_event_mux);
+    (*e)->seq = _event_seq++;
+    (*e)->front = true;
+    portEXIT_CRITICAL(&_async_event_mux);
+    return xQueueSendToFront(_async_queue, e, portMAX_DELAY) == pdPASS;
+}
+
+//Folds a sent or poll event into the newest queued event if that is the same kind for the same client.
+//Streaming clients produce long runs of these; merging them keeps the queue, and so lwIP, from blocking.
+static bool _coalesce_async_event(lwip_event_t event, void * arg, tcp_pcb * pcb, uint16_t len){
+    bool merged = false;
+    portENTER_CRITICAL(&_async_event_mux);
+    lwip_event_packet_t * last = _last_event;
+    if(last && last->event == event && last->arg == arg){
+        if(event == LWIP_TCP_POLL){
+            merged = last->poll.pcb == pcb;
+        } else if(event == LWIP_TCP_SENT && last->sent.pcb == pcb && (uint32_t)last->sent.len + len <= 0xFFFF){
+            last->sent.len += len;
+            merged = true;
+        }
+    }
+    portEXIT_CRITICAL(&_async_event_mux);
+    return merged;
+}
+
+size_t async_tcp_queue_depth(){
+    return _async_queue ? uxQueueMessagesWaiting(_async_queue) : 0;
 }
 
 static inline bool _get_async_event(lwip_event_packet_t ** e){
-    return _async_queue && xQueueReceive(_async_queue, e, portMAX_DELAY) == pdPASS;
+    if(!_async_queue || xQueueReceive(_async_queue, e, portMAX_DELAY) != pdPASS){
+        return false;
+    }
+    portENTER_CRITICAL(&_async_event_mux);
+    if(_last_event == *e){
+        _last_event = NULL; //picked up, nothing may be merged into it any more
+    }
+    portEXIT_CRITICAL(&_async_event_mux);
+    return true;
+}
+
+//Whether an event belongs to a client that was closed after it was queued. Also retires cleared
+//clients once no event queued before their clear can still be waiting: an appended event newer than
+//the clear means every older one has been handled, and so does an empty queue.
+static bool _is_cleared_event(lwip_event_packet_t * e){
+    bool cleared = false;
+    const bool drained = uxQueueMessagesWaiting(_async_queue) == 0;
+    for(size_t i = 0; i < _cleared_count;){
+        const int32_t age = (int32_t)(e->seq - _cleared_args[i].seq);
+        if(age < 0 && e->arg == _cleared_args[i].arg){
+            cleared = true;
+        }
+        if(drained || (age > 0 && !e->front)){
+            _cleared_args[i] = _cleared_args[--_cleared_count];
+        } else {
+            ++i;
+        }
+    }
+    return cleared;
 }
 
-static bool _remove_events_with_arg(void * arg){
+//Frees a packet that was taken off the queue without being handled
+static void _discard_async_event(lwip_event_packet_t * e){
+    portENTER_CRITICAL(&_async_event_mux);
+    if(_last_event == e){
+        _last_event = NULL;
+    }
+    portEXIT_CRITICAL(&_async_event_mux);
+    free(e);
+}
+
+//Drops every queued event for arg in one rotation of the queue. Only used when too many clients
+//were cleared at once for _cleared_args to track them
+static bool _rotate_out_events_with_arg(void * arg){
     lwip_event_packet_t * first_packet = NULL;
     lwip_event_packet_t * packet = NULL;
 
@@ -129,7 +230,7 @@ static bool _remove_events_with_arg(void * arg){
         }
         //discard packet if matching
         if((int)first_packet->arg == (int)arg){
-            free(first_packet);
+            _discard_async_event(first_packet);
             first_packet = NULL;
         //return first packet to the back of the queue
         } else if(xQueueSend(_async_queue, &first_packet, portMAX_DELAY) != pdPASS){
@@ -142,7 +243,7 @@ static bool _remove_events_with_arg(void * arg){
             return false;
         }
         if((int)packet->arg == (int)arg){
-            free(packet);
+            _discard_async_event(packet);
             packet = NULL;
         } else if(xQueueSend(_async_queue, &packet, portMAX_DELAY) != pdPASS){
             return false;
@@ -151,12 +252,26 @@ static bool _remove_events_with_arg(void * arg){
     return true;
 }
 
+//Forgets every event queued for arg before the clear event e. Instead of cycling the whole queue,
+//the client is remembered and its older events are discarded as they come up
+static bool _remove_events_with_arg(lwip_event_packet_t * e){
+    if(_cleared_count < CONFIG_LWIP_MAX_ACTIVE_TCP){
+        _cleared_args[_cleared_count].arg = e->arg;
+        _cleared_args[_cleared_count].seq = e->seq;
+        ++_cleared_count;
+        return true;
+    }
+    return _rotate_out_events_with_arg(e->arg);
+}
+
 static void _handle_async_event(lwip_event_packet_t * e){
     if(e->arg == NULL){
         // do nothing when arg is NULL
         //ets_printf("event arg == NULL: 0x%08x\n", e->recv.pcb);
+    } else if(_is_cleared_event(e)){
+        // client was closed after this was queued
     } else if(e->event == LWIP_TCP_CLEAR){
-        _remove_events_with_arg(e->arg);
+        _remove_events_with_arg(e);
     } else if(e->event == LWIP_TCP_RECV){
         //ets_printf("-R: 0x%08x\n", e->recv.pcb);
         AsyncClient::_s_recv(e->arg, e->recv.pcb, e->recv.pb, e->recv.err);
@@ -218,7 +333,7 @@ static bool _start_async_task(){
         return false;
     }
     if(!_async_service_task_handle){
-        xTaskCreateUniversal(_async_service_task, "async_tcp", 8192 * 2, NULL, 3, &_async_service_task_handle, CONFIG_ASYNC_TCP_RUNNING_CORE);
+        xTaskCreateUniversal(_async_service_task, "async_tcp", CONFIG_ASYNC_TCP_STACK_SIZE, NULL, CONFIG_ASYNC_TCP_PRIORITY, &_async_service_task_handle, CONFIG_ASYNC_TCP_RUNNING_CORE);
         if(!_async_service_task_handle){
             return false;
         }
@@ -255,6 +370,10 @@ static int8_t _tcp_connected(void * arg, tcp_pcb * pcb, int8_t err) {
 
 static int8_t _tcp_poll(void * arg, struct tcp_pcb * pcb) {
     //ets_printf("+P: 0x%08x\n", pcb);
+    //polls are periodic and carry no data, so never let one block lwIP
+    if(async_tcp_queue_depth() >= CONFIG_ASYNC_TCP_POLL_DROP_DEPTH || _coalesce_async_event(LWIP_TCP_POLL, arg, pcb, 0)){
+        return ERR_OK;
+    }
     lwip_event_packet_t * e = (lwip_event_packet_t *)malloc(sizeof(lwip_event_packet_t));
     e->event = LWIP_TCP_POLL;
     e->arg = arg;
@@ -290,6 +409,9 @@ static int8_t _tcp_recv(void * arg, struct tcp_pcb * pcb, struct pbuf *pb, int8_
 
 static int8_t _tcp_sent(void * arg, struct tcp_pcb * pcb, uint16_t len) {
     //ets_printf("+S: 0x%08x\n", pcb);
+    if(_coalesce_async_event(LWIP_TCP_SENT, arg, pcb, len)){
+        return ERR_OK;
+    }
     lwip_event_packet_t * e = (lwip_event_packet_t *)malloc(sizeof(lwip_event_packet_t));
     e->event = LWIP_TCP_SENT;
     e->arg = arg;
@@ -762,6 +884,31 @@ size_t AsyncClient::add(const char* data, size_t size, uint8_t apiflags) {
     return will_send;
 }
 
+//Queues a poll event from any task, so async_tcp runs the poll callback soon instead of at lwIP's
+//next poll. Never blocks: past CONFIG_ASYNC_TCP_POLL_DROP_DEPTH it is skipped like lwIP's polls, and
+//whatever it was for waits for the next ack or poll.
+bool AsyncClient::schedulePoll(){
+    tcp_pcb * pcb = _pcb;
+    if(!pcb){
+        return false;
+    }
+    if(async_tcp_queue_depth() >= CONFIG_ASYNC_TCP_POLL_DROP_DEPTH || _coalesce_async_event(LWIP_TCP_POLL, this, pcb, 0)){
+        return true;
+    }
+    lwip_event_packet_t * e = (lwip_event_packet_t *)malloc(sizeof(lwip_event_packet_t));
+    if(!e){
+        return false;
+    }
+    e->event = LWIP_TCP_POLL;
+    e->arg = this;
+    e->poll.pcb = pcb;
+    if(!_send_async_event(&e, 0)){
+        free((void*)(e));
+        return false;
+    }
+    return true;
+}
+
 bool AsyncClient::send(){
     int8_t err = ERR_OK;
     err = _tcp_output(_pcb, _closed_slot);
@@ -36,8 +36,23 @@ extern "C" {
 #define CONFIG_ASYNC_TCP_USE_WDT 1 //if enabled, adds between 33us and 200us per event
 #endif
 
+#ifndef CONFIG_ASYNC_TCP_PRIORITY
+#define CONFIG_ASYNC_TCP_PRIORITY 3 //priority of the async_tcp task
+#endif
+#ifndef CONFIG_ASYNC_TCP_STACK_SIZE
+#define CONFIG_ASYNC_TCP_STACK_SIZE (8192 * 2) //stack of the async_tcp task, in bytes
+#endif
+#ifndef CONFIG_ASYNC_TCP_QUEUE_SIZE
+#define CONFIG_ASYNC_TCP_QUEUE_SIZE 32 //events lwIP can queue for the async_tcp task before its callbacks block
+#endif
+#ifndef CONFIG_ASYNC_TCP_POLL_DROP_DEPTH
+#define CONFIG_ASYNC_TCP_POLL_DROP_DEPTH (CONFIG_ASYNC_TCP_QUEUE_SIZE * 3 / 4) //queued events at which poll events are skipped
+#endif
+
 class AsyncClient;
 
+size_t async_tcp_queue_depth(); //events waiting for the async_tcp task, for diagnostics
+
 #define ASYNC_MAX_ACK_TIME 5000
 #define ASYNC_WRITE_FLAG_COPY 0x01 //will allocate new buffer to hold the data while sending (else will hold reference to the data given)
 #define ASYNC_WRITE_FLAG_MORE 0x02 //will not send PSH flag, meaning that there should be more data to be sent before the application should react.
@@ -76,6 +91,7 @@ class AsyncClient {
     size_t space();//space available in the TCP window
     size_t add(const char* data, size_t size, uint8_t apiflags=ASYNC_WRITE_FLAG_COPY);//add for sending
     bool send();//send all data added with the method above
+    bool schedulePoll();//have async_tcp call the poll callback soon; from any task, never blocks
 
     //write equals add()+send()
     size_t write(const char* data);
@@ -19,6 +19,8 @@
 */
 #include "Arduino.h"
 #include "AsyncEventSource.h"
+#include <new>
+#include <atomic>
 
 static String generateEventMessage(const char *message, const char *event, uint32_t id, uint32_t reconnect){
   String ev = "";
@@ -104,23 +106,159 @@ static String generateEventMessage(const char *message, const char *event, uint3
   return ev;
 }
 
+// Pools
+
+#ifdef ESP32
+static portMUX_TYPE _poolMux = portMUX_INITIALIZER_UNLOCKED; //guards the pool free lists and payload reference counts
+#endif
+
+//fixed-size free list of uninitialised slots, safe to use from the loop and async_tcp tasks at once
+template<typename T, size_t N>
+class AsyncEventSourcePool {
+  private:
+    union Slot {
+      Slot * next;
+      alignas(T) uint8_t storage[sizeof(T)];
+    };
+    Slot _slots[N];
+    Slot * _free;
+  public:
+    AsyncEventSourcePool() : _free(nullptr) {
+      for(size_t i = 0; i < N; i++){
+        _slots[i].next = _free;
+        _free = &_slots[i];
+      }
+    }
+    void * alloc(){
+#ifdef ESP32
+      portENTER_CRITICAL(&_poolMux);
+#endif
+      Slot * slot = _free;
+      if(slot != nullptr)
+        _free = slot->next;
+#ifdef ESP32
+      portEXIT_CRITICAL(&_poolMux);
+#endif
+      return slot;
+    }
+    bool owns(const void * ptr) const {
+      return ptr >= (const void *)_slots && ptr < (const void *)(_slots + N);
+    }
+    void free(void * ptr){
+      Slot * slot = (Slot *)ptr;
+#ifdef ESP32
+      portENTER_CRITICAL(&_poolMux);
+#endif
+      slot->next = _free;
+      _free = slot;
+#ifdef ESP32
+      portEXIT_CRITICAL(&_poolMux);
+#endif
+    }
+};
+
+static AsyncEventSourcePool<AsyncEventSourceMessage, SSE_MESSAGE_POOL_SIZE> _messagePool;
+static AsyncEventSourcePool<AsyncEventSourcePayload, SSE_PAYLOAD_POOL_SIZE> _payloadPool;
+static std::atomic<uint32_t> _poolMisses(0); //bumped from the stream task and from async_tcp
+
+// Payload
+
+AsyncEventSourcePayload::AsyncEventSourcePayload(const char * data, size_t len)
+: _data(_inline), _len(len), _refs(1)
+{
+  if(_len > SSE_PAYLOAD_SLOT_SIZE){
+    _poolMisses++;
+    _data = (uint8_t*)malloc(_len);
+    if(_data == nullptr){
+      _len = 0;
+      return;
+    }
+  }
+  memcpy(_data, data, _len);
+}
+
+AsyncEventSourcePayload::~AsyncEventSourcePayload(){
+  if(_data != _inline && _data != nullptr)
+    free(_data);
+}
+
+AsyncEventSourcePayload * AsyncEventSourcePayload::create(const char * data, size_t len){
+  void * slot = _payloadPool.alloc();
+  if(slot == nullptr){
+    _poolMisses++;
+    slot = malloc(sizeof(AsyncEventSourcePayload));
+    if(slot == nullptr)
+      return nullptr;
+  }
+  return new (slot) AsyncEventSourcePayload(data, len);
+}
+
+void AsyncEventSourcePayload::retain(){
+#ifdef ESP32
+  portENTER_CRITICAL(&_poolMux);
+#endif
+  _refs++;
+#ifdef ESP32
+  portEXIT_CRITICAL(&_poolMux);
+#endif
+}
+
+void AsyncEventSourcePayload::release(){
+#ifdef ESP32
+  portENTER_CRITICAL(&_poolMux);
+#endif
+  const uint32_t refs = --_refs;
+#ifdef ESP32
+  portEXIT_CRITICAL(&_poolMux);
+#endif
+  if(refs)
+    return;
+  this->~AsyncEventSourcePayload();
+  if(_payloadPool.owns(this))
+    _payloadPool.free(this);
+  else
+    free(this);
+}
+
 // Message
 
 AsyncEventSourceMessage::AsyncEventSourceMessage(const char * data, size_t len)
-: _data(nullptr), _len(len), _sent(0), _acked(0)
+: _payload(AsyncEventSourcePayload::create(data, len)), _len(0), _sent(0), _acked(0)
 {
-  _data = (uint8_t*)malloc(_len+1);
-  if(_data == nullptr){
-    _len = 0;
-  } else {
-    memcpy(_data, data, len);
-    _data[_len] = 0;
-  }
+  if(_payload != nullptr)
+    _len = _payload->length();
+}
+
+AsyncEventSourceMessage::AsyncEventSourceMessage(AsyncEventSourcePayload * payload)
+: _payload(payload), _len(payload->length()), _sent(0), _acked(0)
+{
+  _payload->retain();
 }
 
 AsyncEventSourceMessage::~AsyncEventSourceMessage() {
-     if(_data != NULL)
-        free(_data);
+  if(_payload != nullptr)
+    _payload->release();
+}
+
+void * AsyncEventSourceMessage::operator new(size_t size) noexcept {
+  //noexcept makes a new expression yield NULL instead of constructing into a failed allocation
+  void * slot = _messagePool.alloc();
+  if(slot == nullptr){
+    _poolMisses++;
+    slot = malloc(size);
+  }
+  return slot;
+}
+
+void AsyncEventSourceMessage::operator delete(void * ptr){
+  if(_messagePool.owns(ptr))
+    _messagePool.free(ptr);
+  else
+    free(ptr);
+}
+
+uint32_t AsyncEventSourceMessage::allocCount(){
+  return _poolMisses;
 }
 
 size_t AsyncEventSourceMessage::ack(size_t len, uint32_t time) {
@@ -139,10 +277,10 @@ size_t AsyncEventSourceMessage::ack(size_t len, uint32_t time) {
 
 size_t AsyncEventSourceMessage::send(AsyncClient *client) {
   const size_t len = _len - _sent;
-  if(client->space() < len){
+  if(len == 0 || client->space() < len){
     return 0;
   }
-  size_t sent = client->add((const char *)_data, len);
+  size_t sent = client->add((const char *)_payload->data() + _sent, len);
   if(client->canSend())
     client->send();
   _sent += sent;
@@ -152,10 +290,11 @@ size_t AsyncEventSourceMessage::send(AsyncClient *client) {
 // Client
 
 AsyncEventSourceClient::AsyncEventSourceClient(AsyncWebServerRequest *request, AsyncEventSource *server)
-: _messageQueue(LinkedList<AsyncEventSourceMessage *>([](AsyncEventSourceMessage *m){ delete  m; }))
+: _queueHead(0), _queueLength(0)
 {
   _client = request->client();
   _server = server;
+  _clientId = _server->_getNextId();
   _lastId = 0;
   if(request->hasHeader("Last-Event-ID"))
     _lastId = atoi(request->getHeader("Last-Event-ID")->value().c_str());
@@ -173,39 +312,54 @@ AsyncEventSourceClient::AsyncEventSourceClient(AsyncWebServerRequest *request, A
 }
 
 AsyncEventSourceClient::~AsyncEventSourceClient(){
-   _messageQueue.free();
+  AsyncWebLockGuard l(_lockmq);
+  while(_queueLength)
+    _popMessage();
   close();
 }
 
-void AsyncEventSourceClient::_queueMessage(AsyncEventSourceMessage *dataMessage){
+bool AsyncEventSourceClient::_queueMessage(AsyncEventSourceMessage *dataMessage){
   if(dataMessage == NULL)
-    return;
+    return false;
+  //the stream task queues while async_tcp pops on ack
+  AsyncWebLockGuard l(_lockmq);
   if(!connected()){
     delete dataMessage;
-    return;
+    return false;
   }
-  if(_messageQueue.length() >= SSE_MAX_QUEUED_MESSAGES){
+  bool queued = _queueLength < SSE_MAX_QUEUED_MESSAGES;
+  if(!queued){
       ets_printf("ERROR: Too many messages queued\n");
       delete dataMessage;
   } else {
-      _messageQueue.add(dataMessage);
+      _messageQueue[(_queueHead + _queueLength) % SSE_MAX_QUEUED_MESSAGES] = dataMessage;
+      _queueLength++;
+      //sent from _onPoll on async_tcp: sending can block on lwIP, which can wait on async_tcp, which can wait on this lock
+      _client->schedulePoll();
   }
-  if(_client->canSend())
-    _runQueue();
+  return queued;
+}
+
+void AsyncEventSourceClient::_popMessage(){
+  delete _messageQueue[_queueHead];
+  _queueHead = (_queueHead + 1) % SSE_MAX_QUEUED_MESSAGES;
+  _queueLength--;
 }
 
 void AsyncEventSourceClient::_onAck(size_t len, uint32_t time){
-  while(len && !_messageQueue.isEmpty()){
-    len = _messageQueue.front()->ack(len, time);
-    if(_messageQueue.front()->finished())
-      _messageQueue.remove(_messageQueue.front());
+  AsyncWebLockGuard l(_lockmq);
+  while(len && _queueLength){
+    len = _messageQueue[_queueHead]->ack(len, time);
+    if(_messageQueue[_queueHead]->finished())
+      _popMessage();
   }
 
   _runQueue();
 }
 
 void AsyncEventSourceClient::_onPoll(){
-  if(!_messageQueue.isEmpty()){
+  AsyncWebLockGuard l(_lockmq);
+  if(_queueLength){
     _runQueue();
   }
 }
@@ -216,7 +370,11 @@ void AsyncEventSourceClient::_onTimeout(uint32_t time __attribute__((unused))){
 }
 
 void AsyncEventSourceClient::_onDisconnect(){
-  _client = NULL;
+  {
+    //not across _handleDisconnect, which deletes this client
+    AsyncWebLockGuard l(_lockmq);
+    _client = NULL;
+  }
   _server->_handleDisconnect(this);
 }
 
@@ -225,8 +383,14 @@ void AsyncEventSourceClient::close(){
     _client->close();
 }
 
-void AsyncEventSourceClient::write(const char * message, size_t len){
-  _queueMessage(new AsyncEventSourceMessage(message, len));
+bool AsyncEventSourceClient::write(const char * message, size_t len){
+  return _queueMessage(new AsyncEventSourceMessage(message, len));
+}
+
+bool AsyncEventSourceClient::write(AsyncEventSourcePayload * payload){
+  if(payload == NULL)
+    return false;
+  return _queueMessage(new AsyncEventSourceMessage(payload));
 }
 
 void AsyncEventSourceClient::send(const char *message, const char *event, uint32_t id, uint32_t reconnect){
@@ -235,14 +399,16 @@ void AsyncEventSourceClient::send(const char *message, const char *event, uint32
 }
 
 void AsyncEventSourceClient::_runQueue(){
-  while(!_messageQueue.isEmpty() && _messageQueue.front()->finished()){
-    _messageQueue.remove(_messageQueue.front());
+  AsyncWebLockGuard l(_lockmq);
+  while(_queueLength && _messageQueue[_queueHead]->finished()){
+    _popMessage();
   }
 
-  for(auto i = _messageQueue.begin(); i != _messageQueue.end(); ++i)
+  for(size_t i = 0; i < _queueLength; i++)
   {
-    if(!(*i)->sent())
-      (*i)->send(_client);
+    AsyncEventSourceMessage * m = _messageQueue[(_queueHead + i) % SSE_MAX_QUEUED_MESSAGES];
+    if(!m->sent())
+      m->send(_client);
   }
 }
 
@@ -252,6 +418,7 @@ void AsyncEventSourceClient::_runQueue(){
 AsyncEventSource::AsyncEventSource(const String& url)
   : _url(url)
   , _clients(LinkedList<AsyncEventSourceClient *>([](AsyncEventSourceClient *c){ delete c; }))
+  , _cNextId(1)
   , _connectcb(NULL)
 {}
 
@@ -277,16 +444,20 @@ void AsyncEventSource::_addClient(AsyncEventSourceClient * client){
     free(temp);
   }*/
   
-  _clients.add(client);
+  //the callback runs first so whatever it sends is queued ahead of the next broadcast
   if(_connectcb)
     _connectcb(client);
+  AsyncWebLockGuard l(_client_queue_lock);
+  _clients.add(client);
 }
 
 void AsyncEventSource::_handleDisconnect(AsyncEventSourceClient * client){
+  AsyncWebLockGuard l(_client_queue_lock);
   _clients.remove(client);
 }
 
 void AsyncEventSource::close(){
+  AsyncWebLockGuard l(_client_queue_lock);
   for(const auto &c: _clients){
     if(c->connected())
       c->close();
@@ -295,6 +466,7 @@ void AsyncEventSource::close(){
 
 // pmb fix
 size_t AsyncEventSource::avgPacketsWaiting() const {
+  AsyncWebLockGuard l(_client_queue_lock);
   if(_clients.isEmpty())
     return 0;
   
@@ -315,14 +487,25 @@ void AsyncEventSource::send(const char *message, const char *event, uint32_t id,
 
 
   String ev = generateEventMessage(message, event, id, reconnect);
+  write(ev.c_str(), ev.length());
+}
+
+void AsyncEventSource::write(const char * message, size_t len){
+  //one payload for every client, each queued message only holds a reference to it
+  AsyncEventSourcePayload * payload = AsyncEventSourcePayload::create(message, len);
+  if(payload == NULL)
+    return;
+  AsyncWebLockGuard l(_client_queue_lock);
   for(const auto &c: _clients){
     if(c->connected()) {
-      c->write(ev.c_str(), ev.length());
+      c->write(payload);
     }
   }
+  payload->release();
 }
 
 size_t AsyncEventSource::count() const {
+  AsyncWebLockGuard l(_client_queue_lock);
   return _clients.count_if([](AsyncEventSourceClient *c){
     return c->connected();
   });
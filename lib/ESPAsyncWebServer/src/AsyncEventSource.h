@@ -45,21 +45,55 @@
 #define DEFAULT_MAX_SSE_CLIENTS 4
 #endif
 
+//messages queued on clients are carved from a fixed slab, heap is only used once it runs out
+#ifndef SSE_MESSAGE_POOL_SIZE
+#define SSE_MESSAGE_POOL_SIZE (SSE_MAX_QUEUED_MESSAGES * DEFAULT_MAX_SSE_CLIENTS)
+#endif
+//broadcast payloads are shared by every client, so one slot per queued event is enough
+#ifndef SSE_PAYLOAD_POOL_SIZE
+#define SSE_PAYLOAD_POOL_SIZE SSE_MAX_QUEUED_MESSAGES
+#endif
+//payloads larger than this always go to the heap
+#ifndef SSE_PAYLOAD_SLOT_SIZE
+#define SSE_PAYLOAD_SLOT_SIZE 512
+#endif
+
 class AsyncEventSource;
 class AsyncEventSourceResponse;
 class AsyncEventSourceClient;
 typedef std::function<void(AsyncEventSourceClient *client)> ArEventHandlerFunction;
 
+//reference counted event record, shared by the messages queued on every client
+class AsyncEventSourcePayload {
+  private:
+    uint8_t * _data;
+    size_t _len;
+    uint32_t _refs;
+    uint8_t _inline[SSE_PAYLOAD_SLOT_SIZE];
+    AsyncEventSourcePayload(const char * data, size_t len);
+    ~AsyncEventSourcePayload();
+  public:
+    static AsyncEventSourcePayload * create(const char * data, size_t len); //returns with one reference held
+    void retain();
+    void release(); //frees the payload when the last reference goes
+    const uint8_t * data() const { return _data; }
+    size_t length() const { return _len; }
+};
+
 class AsyncEventSourceMessage {
   private:
-    uint8_t * _data; 
+    AsyncEventSourcePayload * _payload;
     size_t _len;
     size_t _sent;
     //size_t _ack;
     size_t _acked; 
   public:
     AsyncEventSourceMessage(const char * data, size_t len);
+    AsyncEventSourceMessage(AsyncEventSourcePayload * payload);
     ~AsyncEventSourceMessage();
+    static void * operator new(size_t size) noexcept; //NULL when both the pool and the heap are exhausted
+    static void operator delete(void * ptr);
+    static uint32_t allocCount(); //heap allocations made because the message or payload pool ran out, since boot
     size_t ack(size_t len, uint32_t time __attribute__((unused)));
     size_t send(AsyncClient *client);
     bool finished(){ return _acked == _len; }
@@ -71,8 +105,13 @@ class AsyncEventSourceClient {
     AsyncClient *_client;
     AsyncEventSource *_server;
     uint32_t _lastId;
-    LinkedList<AsyncEventSourceMessage *> _messageQueue;
-    void _queueMessage(AsyncEventSourceMessage *dataMessage);
+    uint32_t _clientId;
+    AsyncEventSourceMessage * _messageQueue[SSE_MAX_QUEUED_MESSAGES]; //fixed ring, oldest at _queueHead
+    size_t _queueHead;
+    size_t _queueLength;
+    AsyncWebLock _lockmq; //guards the ring, filled by the stream task and drained on async_tcp
+    bool _queueMessage(AsyncEventSourceMessage *dataMessage);
+    void _popMessage();
     void _runQueue();
 
   public:
@@ -82,11 +121,13 @@ class AsyncEventSourceClient {
 
     AsyncClient* client(){ return _client; }
     void close();
-    void write(const char * message, size_t len);
+    bool write(const char * message, size_t len); //false if the message was dropped
+    bool write(AsyncEventSourcePayload * payload); //queue a shared payload without copying it, false if dropped
     void send(const char *message, const char *event=NULL, uint32_t id=0, uint32_t reconnect=0);
     bool connected() const { return (_client != NULL) && _client->connected(); }
     uint32_t lastId() const { return _lastId; }
-    size_t  packetsWaiting() const { return _messageQueue.length(); }
+    uint32_t id() const { return _clientId; } //unique per server, unlike the address of a client that has been freed
+    size_t  packetsWaiting() const { return _queueLength; }
 
     //system callbacks (do not call)
     void _onAck(size_t len, uint32_t time);
@@ -99,6 +140,8 @@ class AsyncEventSource: public AsyncWebHandler {
   private:
     String _url;
     LinkedList<AsyncEventSourceClient *> _clients;
+    AsyncWebLock _client_queue_lock; //guards _clients, changed on async_tcp and walked by the stream task
+    uint32_t _cNextId;
     ArEventHandlerFunction _connectcb;
   public:
     AsyncEventSource(const String& url);
@@ -108,10 +151,14 @@ class AsyncEventSource: public AsyncWebHandler {
     void close();
     void onConnect(ArEventHandlerFunction cb);
     void send(const char *message, const char *event=NULL, uint32_t id=0, uint32_t reconnect=0);
+    void write(const char * message, size_t len); //queue an already formatted event record on every client
     size_t count() const; //number clinets connected
     size_t  avgPacketsWaiting() const;
+    const LinkedList<AsyncEventSourceClient *> & clients() const { return _clients; } //for per-client sends, check connected() first
+    const AsyncWebLock & clientsLock() const { return _client_queue_lock; } //hold with AsyncWebLockGuard while walking clients()
 
     //system callbacks (do not call)
+    uint32_t _getNextId(){ return _cNextId++; }
     void _addClient(AsyncEventSourceClient * client);
     void _handleDisconnect(AsyncEventSourceClient * client);
     virtual bool canHandle(AsyncWebServerRequest *request) override final;
@@ -165,7 +165,7 @@ AsyncWebSocketMessageBuffer::AsyncWebSocketMessageBuffer(const AsyncWebSocketMes
   ,_count(0)
 {
   _len = copy._len;
-  _lock = copy._lock;
+  _lock = copy._lock.load();
   _count = 0;
 
   if (_len) {
@@ -187,7 +187,7 @@ AsyncWebSocketMessageBuffer::AsyncWebSocketMessageBuffer(AsyncWebSocketMessageBu
   ,_count(0)
 {
   _len = copy._len;
-  _lock = copy._lock;
+  _lock = copy._lock.load();
   _count = 0;
 
   if (copy._data) {
@@ -488,34 +488,43 @@ AsyncWebSocketClient::AsyncWebSocketClient(AsyncWebServerRequest *request, Async
 }
 
 AsyncWebSocketClient::~AsyncWebSocketClient(){
-  _messageQueue.free();
-  _controlQueue.free();
+  {
+    AsyncWebLockGuard l(_lockmq);
+    _messageQueue.free();
+    _controlQueue.free();
+  }
   _server->_handleEvent(this, WS_EVT_DISCONNECT, NULL, NULL, 0);
 }
 
 void AsyncWebSocketClient::_onAck(size_t len, uint32_t time){
   _lastMessageTime = millis();
-  if(!_controlQueue.isEmpty()){
-    auto head = _controlQueue.front();
-    if(head->finished()){
-      len -= head->len();
-      if(_status == WS_DISCONNECTING && head->opcode() == WS_DISCONNECT){
+  bool closing = false;
+  {
+    //released before closing, which deletes this client, and before taking the server lock
+    AsyncWebLockGuard l(_lockmq);
+    if(!_controlQueue.isEmpty()){
+      auto head = _controlQueue.front();
+      if(head->finished()){
+        len -= head->len();
+        closing = _status == WS_DISCONNECTING && head->opcode() == WS_DISCONNECT;
         _controlQueue.remove(head);
-        _status = WS_DISCONNECTED;
-        _client->close(true);
-        return;
       }
-      _controlQueue.remove(head);
+    }
+    if(!closing && len && !_messageQueue.isEmpty()){
+      _messageQueue.front()->ack(len, time);
     }
   }
-  if(len && !_messageQueue.isEmpty()){
-    _messageQueue.front()->ack(len, time);
+  if(closing){
+    _status = WS_DISCONNECTED;
+    _client->close(true);
+    return;
   }
   _server->_cleanBuffers(); 
   _runQueue();
 }
 
 void AsyncWebSocketClient::_onPoll(){
+  AsyncWebLockGuard l(_lockmq);
   if(_client->canSend() && (!_controlQueue.isEmpty() || !_messageQueue.isEmpty())){
     _runQueue();
   } else if(_keepAlivePeriod > 0 && _controlQueue.isEmpty() && _messageQueue.isEmpty() && (millis() - _lastMessageTime) >= _keepAlivePeriod){
@@ -524,6 +533,7 @@ void AsyncWebSocketClient::_onPoll(){
 }
 
 void AsyncWebSocketClient::_runQueue(){
+  AsyncWebLockGuard l(_lockmq);
   while(!_messageQueue.isEmpty() && _messageQueue.front()->finished()){
     _messageQueue.remove(_messageQueue.front());
   }
@@ -536,6 +546,7 @@ void AsyncWebSocketClient::_runQueue(){
 }
 
 bool AsyncWebSocketClient::queueIsFull(){
+  AsyncWebLockGuard l(_lockmq);
   if((_messageQueue.length() >= WS_MAX_QUEUED_MESSAGES) || (_status != WS_CONNECTED) ) return true;
   return false;
 }
@@ -543,6 +554,8 @@ bool AsyncWebSocketClient::queueIsFull(){
 void AsyncWebSocketClient::_queueMessage(AsyncWebSocketMessage *dataMessage){
   if(dataMessage == NULL)
     return;
+  //the stream task queues while async_tcp sends and acks
+  AsyncWebLockGuard l(_lockmq);
   if(_status != WS_CONNECTED){
     delete dataMessage;
     return;
@@ -552,17 +565,19 @@ void AsyncWebSocketClient::_queueMessage(AsyncWebSocketMessage *dataMessage){
       delete dataMessage;
   } else {
       _messageQueue.add(dataMessage);
+      //sent from _onPoll on async_tcp: sending can block on lwIP, which can wait on async_tcp, which can wait on this lock
+      if(_client != NULL)
+        _client->schedulePoll();
   }
-  if(_client->canSend())
-    _runQueue();
 }
 
 void AsyncWebSocketClient::_queueControl(AsyncWebSocketControl *controlMessage){
   if(controlMessage == NULL)
     return;
+  AsyncWebLockGuard l(_lockmq);
   _controlQueue.add(controlMessage);
-  if(_client->canSend())
-    _runQueue();
+  if(_client != NULL)
+    _client->schedulePoll();
 }
 
 void AsyncWebSocketClient::close(uint16_t code, const char * message){
@@ -603,7 +618,11 @@ void AsyncWebSocketClient::_onTimeout(uint32_t time){
 }
 
 void AsyncWebSocketClient::_onDisconnect(){
-  _client = NULL;
+  {
+    //not across _handleDisconnect, which deletes this client
+    AsyncWebLockGuard l(_lockmq);
+    _client = NULL;
+  }
   _server->_handleDisconnect(this);
 }
 
@@ -866,17 +885,19 @@ void AsyncWebSocket::_handleEvent(AsyncWebSocketClient * client, AwsEventType ty
 }
 
 void AsyncWebSocket::_addClient(AsyncWebSocketClient * client){
+  AsyncWebLockGuard l(_lock);
   _clients.add(client);
 }
 
 void AsyncWebSocket::_handleDisconnect(AsyncWebSocketClient * client){
-  
+  AsyncWebLockGuard l(_lock);
   _clients.remove_first([=](AsyncWebSocketClient * c){
     return c->id() == client->id();
   });
 }
 
 bool AsyncWebSocket::availableForWriteAll(){
+  AsyncWebLockGuard l(_lock);
   for(const auto& c: _clients){
     if(c->queueIsFull()) return false;
   }
@@ -884,6 +905,7 @@ bool AsyncWebSocket::availableForWriteAll(){
 }
 
 bool AsyncWebSocket::availableForWrite(uint32_t id){
+  AsyncWebLockGuard l(_lock);
   for(const auto& c: _clients){
     if(c->queueIsFull() && (c->id() == id )) return false;
   }
@@ -891,12 +913,14 @@ bool AsyncWebSocket::availableForWrite(uint32_t id){
 }
 
 size_t AsyncWebSocket::count() const {
+  AsyncWebLockGuard l(_lock);
   return _clients.count_if([](AsyncWebSocketClient * c){
     return c->status() == WS_CONNECTED;
   });
 }
 
 AsyncWebSocketClient * AsyncWebSocket::client(uint32_t id){
+  AsyncWebLockGuard l(_lock);
   for(const auto &c: _clients){
     if(c->id() == id && c->status() == WS_CONNECTED){
       return c;
@@ -913,6 +937,7 @@ void AsyncWebSocket::close(uint32_t id, uint16_t code, const char * message){
 }
 
 void AsyncWebSocket::closeAll(uint16_t code, const char * message){
+  AsyncWebLockGuard l(_lock);
   for(const auto& c: _clients){
     if(c->status() == WS_CONNECTED)
       c->close(code, message);
@@ -921,6 +946,7 @@ void AsyncWebSocket::closeAll(uint16_t code, const char * message){
 
 void AsyncWebSocket::cleanupClients(uint16_t maxClients)
 {
+  AsyncWebLockGuard l(_lock);
   if (count() > maxClients){
     _clients.front()->close();
   }
@@ -933,6 +959,7 @@ void AsyncWebSocket::ping(uint32_t id, uint8_t *data, size_t len){
 }
 
 void AsyncWebSocket::pingAll(uint8_t *data, size_t len){
+  AsyncWebLockGuard l(_lock);
   for(const auto& c: _clients){
     if(c->status() == WS_CONNECTED)
       c->ping(data, len);
@@ -948,6 +975,7 @@ void AsyncWebSocket::text(uint32_t id, const char * message, size_t len){
 void AsyncWebSocket::textAll(AsyncWebSocketMessageBuffer * buffer){
   if (!buffer) return;
   buffer->lock(); 
+  AsyncWebLockGuard l(_lock);
   for(const auto& c: _clients){
     if(c->status() == WS_CONNECTED){
         c->text(buffer);
@@ -978,6 +1006,7 @@ void AsyncWebSocket::binaryAll(AsyncWebSocketMessageBuffer * buffer)
 {
   if (!buffer) return;
   buffer->lock(); 
+  AsyncWebLockGuard l(_lock);
     for(const auto& c: _clients){
     if(c->status() == WS_CONNECTED)
       c->binary(buffer);
@@ -993,6 +1022,7 @@ void AsyncWebSocket::message(uint32_t id, AsyncWebSocketMessage *message){
 }
 
 void AsyncWebSocket::messageAll(AsyncWebSocketMultiMessage *message){
+  AsyncWebLockGuard l(_lock);
   for(const auto& c: _clients){
     if(c->status() == WS_CONNECTED)
       c->message(message);
@@ -1104,6 +1134,7 @@ void AsyncWebSocket::textAll(const String &message){
   textAll(message.c_str(), message.length());
 }
 void AsyncWebSocket::textAll(const __FlashStringHelper *message){
+  AsyncWebLockGuard l(_lock);
   for(const auto& c: _clients){
     if(c->status() == WS_CONNECTED)
       c->text(message);
@@ -1139,6 +1170,7 @@ void AsyncWebSocket::binaryAll(const String &message){
   binaryAll(message.c_str(), message.length());
 }
 void AsyncWebSocket::binaryAll(const __FlashStringHelper *message, size_t len){
+  AsyncWebLockGuard l(_lock);
   for(const auto& c: _clients){
     if(c->status() == WS_CONNECTED)
       c-> binary(message, len);
@@ -1229,6 +1261,7 @@ void AsyncWebSocket::_cleanBuffers()
 }
 
 AsyncWebSocket::AsyncWebSocketClientLinkedList AsyncWebSocket::getClients() const {
+  AsyncWebLockGuard l(_lock);
   return _clients;
 }
 
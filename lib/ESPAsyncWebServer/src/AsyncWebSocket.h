@@ -22,6 +22,7 @@
 #define ASYNCWEBSOCKET_H_
 
 #include <Arduino.h>
+#include <atomic>
 #ifdef ESP32
 #include <AsyncTCP.h>
 #define WS_MAX_QUEUED_MESSAGES 32
@@ -84,8 +85,8 @@ class AsyncWebSocketMessageBuffer {
   private:
     uint8_t * _data;
     size_t _len;
-    bool _lock; 
-    uint32_t _count;  
+    std::atomic<bool> _lock; //set by the stream task, read on async_tcp
+    std::atomic<uint32_t> _count; //messages referencing the buffer, queued and freed on different tasks
 
   public:
     AsyncWebSocketMessageBuffer();
@@ -163,6 +164,7 @@ class AsyncWebSocketClient {
 
     LinkedList<AsyncWebSocketControl *> _controlQueue;
     LinkedList<AsyncWebSocketMessage *> _messageQueue;
+    AsyncWebLock _lockmq; //guards both queues, filled by the stream task and drained on async_tcp
 
     uint8_t _pstate;
     AwsFrameInfo _pinfo;
@@ -226,7 +228,7 @@ class AsyncWebSocketClient {
     void binary(const __FlashStringHelper *data, size_t len);
     void binary(AsyncWebSocketMessageBuffer *buffer); 
 
-    bool canSend() { return _messageQueue.length() < WS_MAX_QUEUED_MESSAGES; }
+    bool canSend() { AsyncWebLockGuard l(_lockmq); return _messageQueue.length() < WS_MAX_QUEUED_MESSAGES; }
 
     //system callbacks (do not call)
     void _onAck(size_t len, uint32_t time);
@@ -249,7 +251,7 @@ class AsyncWebSocket: public AsyncWebHandler {
     uint32_t _cNextId;
     AwsEventHandler _eventHandler;
     bool _enabled;
-    AsyncWebLock _lock;
+    AsyncWebLock _lock; //guards _clients and _buffers
 
   public:
     AsyncWebSocket(const String& url);
@@ -258,6 +260,8 @@ class AsyncWebSocket: public AsyncWebHandler {
     void enable(bool e){ _enabled = e; }
     bool enabled() const { return _enabled; }
     bool availableForWriteAll();
+    const AsyncWebSocketClientLinkedList & clients() const { return _clients; } //for per-client sends, check status() first
+    const AsyncWebLock & clientsLock() const { return _lock; } //hold with AsyncWebLockGuard while walking clients()
     bool availableForWrite(uint32_t id);
 
     size_t count() const;
@@ -0,0 +1,101 @@
+"""
+Builds the waveform pack the firmware maps from its "wavepack" partition (see src/WavePack.h).
+
+Every waves/<name>.txt is one beat of one rhythm: integers 0 to 255 separated by commas or
+whitespace, a power-of-two count of them between 4 and 65536, and '#' comments. The file name
+without the extension, at most 11 characters, is the name used by the control API.
+
+Used as a PlatformIO extra script it adds an "uploadwaves" target that builds the pack and writes
+it to the partition's offset in partitions.csv:
+
+    pio run -e esp32dev -t uploadwaves
+
+It can also be run by hand: python scripts/build_wavepack.py <waves dir> <output file>
+"""
+
+import os
+import re
+import struct
+import sys
+
+MAGIC = 0x4B505657  # WAVEPACK_MAGIC
+VERSION = 1  # WAVEPACK_VERSION
+NAME_MAX = 12  # WAVEPACK_NAME_MAX, terminator included
+MAX_TABLES = 64  # WAVEPACK_MAX_TABLES
+HEADER = struct.Struct("<IHHI")  # WavePackHeader
+ENTRY = struct.Struct("<%dsIB3x" % NAME_MAX)  # WavePackEntry
+PARTITION = "wavepack"
+
+
+def read_table(path):
+    with open(path) as f:
+        text = re.sub(r"#.*", "", f.read())
+    points = [int(v) for v in re.split(r"[\s,]+", text) if v]
+    bits = len(points).bit_length() - 1
+    if len(points) != 1 << bits or not 2 <= bits <= 16:
+        raise ValueError("%s has %d points, not a power of two between 4 and 65536" % (path, len(points)))
+    if any(not 0 <= p <= 255 for p in points):
+        raise ValueError("%s has points outside 0 to 255" % path)
+    return bits, bytes(points)
+
+
+def build(source_dir, output):
+    names = sorted(n for n in os.listdir(source_dir) if n.endswith(".txt"))
+    if len(names) > MAX_TABLES:
+        raise ValueError("%d tables, the firmware indexes at most %d" % (len(names), MAX_TABLES))
+
+    tables = []
+    for name in names:
+        stem = name[:-len(".txt")]
+        if len(stem) >= NAME_MAX:
+            raise ValueError("%s is longer than %d characters" % (stem, NAME_MAX - 1))
+        tables.append((stem,) + read_table(os.path.join(source_dir, name)))
+
+    offset = HEADER.size + ENTRY.size * len(tables)
+    index = b""
+    points = b""
+    for stem, bits, data in tables:
+        index += ENTRY.pack(stem.encode(), offset + len(points), bits)
+        points += data
+    pack = HEADER.pack(MAGIC, VERSION, len(tables), offset + len(points)) + index + points
+
+    with open(output, "wb") as f:
+        f.write(pack)
+    for stem, bits, _ in tables:
+        print("waveform %s: %d points" % (stem, 1 << bits))
+    print("waveform pack: %d tables, %d bytes" % (len(tables), len(pack)))
+    return len(pack)
+
+
+def partition_offset(csv_path):
+    with open(csv_path) as f:
+        for line in f:
+            fields = [v.strip() for v in line.split("#")[0].split(",")]
+            if fields[0] == PARTITION:
+                return int(fields[3], 0), int(fields[4], 0)
+    raise ValueError("%s has no %s partition" % (csv_path, PARTITION))
+
+
+if __name__ == "__main__":
+    if len(sys.argv) != 3:
+        sys.exit("usage: build_wavepack.py <waves dir> <output file>")
+    build(sys.argv[1], sys.argv[2])
+else:
+    Import("env")  # noqa: F821 - provided by PlatformIO
+
+    def upload_waves(target, source, env):
+        offset, size = partition_offset(os.path.join(env.subst("$PROJECT_DIR"), env.GetProjectOption("board_build.partitions")))
+        output = os.path.join(env.subst("$BUILD_DIR"), "wavepack.bin")
+        if build(os.path.join(env.subst("$PROJECT_DIR"), "waves"), output) > size:
+            sys.exit("the waveform pack does not fit its %d byte partition" % size)
+        env.AutodetectUploadPort()
+        return env.Execute(env.VerboseAction(
+            '"$PYTHONEXE" "$UPLOADER" --chip esp32 --port "$UPLOAD_PORT" --baud $UPLOAD_SPEED write_flash 0x%x "%s"' % (offset, output),
+            "Writing the waveform pack at 0x%x" % offset))
+
+    env.AddCustomTarget(  # noqa: F821
+        name="uploadwaves",
+        dependencies=None,
+        actions=upload_waves,
+        title="Upload waveform pack",
+        description="Build waves/ into a waveform pack and write it to the wavepack partition")
@@ -0,0 +1,106 @@
+"""
+Builds the filesystem image contents from data/.
+
+Static assets (scripts, styles, images) get a content hash in their name and are placed under
+/a/, where the firmware serves them with a cache-forever Cache-Control header. Text assets are
+stored gzipped only; the web server picks up the .gz file and sends Content-Encoding: gzip.
+HTML pages keep their names, are rewritten to reference the hashed assets and are gzipped too.
+Anything else (the network settings files) is copied unchanged. /webbuild.txt holds a hash of
+the whole set, which the firmware uses as the ETag of the pages.
+
+Used as a PlatformIO extra script; it only runs for the filesystem targets. It can also be run
+by hand: python scripts/build_web_assets.py <data dir> <output dir>
+"""
+
+import gzip
+import hashlib
+import os
+import re
+import shutil
+import sys
+
+ASSET_DIR = "a"
+HASHED_EXTENSIONS = (".js", ".css", ".png", ".ico", ".svg")
+PAGE_EXTENSIONS = (".html", ".htm")
+GZIP_EXTENSIONS = (".js", ".css", ".svg", ".ico") + PAGE_EXTENSIONS
+BUILD_ID_FILE = "webbuild.txt"
+SPIFFS_NAME_MAX = 31  # SPIFFS_OBJ_NAME_LEN minus the terminator
+
+
+def _gzip(data):
+    # mtime=0 keeps the output, and so the hashes, reproducible
+    return gzip.compress(data, compresslevel=9, mtime=0)
+
+
+def _write(path, data):
+    os.makedirs(os.path.dirname(path), exist_ok=True)
+    with open(path, "wb") as f:
+        f.write(data)
+
+
+def _check_name(name):
+    if len(name) > SPIFFS_NAME_MAX:
+        raise ValueError("%s is longer than SPIFFS allows (%d > %d)" % (name, len(name), SPIFFS_NAME_MAX))
+
+
+def build(source_dir, output_dir):
+    if os.path.isdir(output_dir):
+        shutil.rmtree(output_dir)
+    os.makedirs(output_dir)
+
+    names = sorted(n for n in os.listdir(source_dir) if os.path.isfile(os.path.join(source_dir, n)))
+    renamed = {}
+    build_hash = hashlib.sha256()
+
+    for name in names:
+        stem, ext = os.path.splitext(name)
+        if ext.lower() not in HASHED_EXTENSIONS:
+            continue
+        with open(os.path.join(source_dir, name), "rb") as f:
+            data = f.read()
+        digest = hashlib.sha256(data).hexdigest()[:8]
+        hashed = "/%s/%s.%s%s" % (ASSET_DIR, stem, digest, ext)
+        renamed[name] = hashed
+        stored = hashed
+        if ext.lower() in GZIP_EXTENSIONS:
+            data = _gzip(data)
+            stored += ".gz"
+        _check_name(stored)
+        _write(os.path.join(output_dir, stored.lstrip("/")), data)
+        build_hash.update(stored.encode())
+
+    reference = re.compile(r'((?:href|src)\s*=\s*")\s*(?:\./|/)?([^"/?#\s]+)\s*(")')
+
+    for name in names:
+        ext = os.path.splitext(name)[1].lower()
+        if ext in HASHED_EXTENSIONS:
+            continue
+        with open(os.path.join(source_dir, name), "rb") as f:
+            data = f.read()
+        stored = "/" + name
+        if ext in PAGE_EXTENSIONS:
+            text = reference.sub(lambda m: m.group(1) + renamed.get(m.group(2), m.group(2)) + m.group(3), data.decode("utf-8"))
+            data = _gzip(text.encode("utf-8"))
+            stored += ".gz"
+            build_hash.update(data)
+        _check_name(stored)
+        _write(os.path.join(output_dir, stored.lstrip("/")), data)
+
+    _write(os.path.join(output_dir, BUILD_ID_FILE), build_hash.hexdigest()[:16].encode())
+    for original, hashed in sorted(renamed.items()):
+        print("web asset %s -> %s" % (original, hashed))
+
+
+if __name__ == "__main__":
+    if len(sys.argv) != 3:
+        sys.exit("usage: build_web_assets.py <data dir> <output dir>")
+    build(sys.argv[1], sys.argv[2])
+else:
+    Import("env")  # noqa: F821 - provided by PlatformIO
+
+    FS_TARGETS = ("buildfs", "uploadfs", "uploadfsota")
+    if any(t in FS_TARGETS for t in COMMAND_LINE_TARGETS):  # noqa: F821
+        source = env.subst("$PROJECT_DATA_DIR")
+        output = os.path.join(env.subst("$PROJECT_BUILD_DIR"), env.subst("$PIOENV"), "webfs")
+        build(source, output)
+        env.Replace(PROJECT_DATA_DIR=output)
@@ -0,0 +1,197 @@
+"""
+Static memory footprint of a firmware build, by module: DRAM data and bss, IRAM and flash.
+
+Reads the linker map of an esp32 build and adds up the input sections of every object by the output
+section they were placed in. Objects built from src/ are listed by source file, everything in an
+archive (the libraries in lib/, the Arduino core, ESP-IDF, libc) by archive, or by archive member
+with --by-object. "ram" is data + bss, what the build takes from DRAM before the heap; "flash" is
+code + rodata + data + iram, what it takes from the app partition.
+
+    pio run -t footprint
+    python scripts/footprint.py .pio/build/esp32dev/firmware.map --top 20 --sort iram
+    python scripts/footprint.py firmware.map --save before.json
+    python scripts/footprint.py firmware.map --compare before.json
+
+--compare prints what changed per module against a saved report. The footprint target does that
+against the report from its previous run, so running it before and after a change shows what the
+change costs. As a PlatformIO extra script this file also makes the linker write the map.
+Only the standard library is used.
+"""
+
+import argparse
+import json
+import os
+import re
+import sys
+
+# Output sections of the esp32 linker scripts, by the column they are counted in
+REGIONS = {
+    ".dram0.data": "data",
+    ".dram0.bss": "bss",
+    ".noinit": "bss",
+    ".iram0.vectors": "iram",
+    ".iram0.text": "iram",
+    ".iram0.data": "iram",
+    ".iram0.bss": "iram",
+    ".flash.text": "code",
+    ".flash.appdesc": "rodata",
+    ".flash.rodata": "rodata",
+}
+COLUMNS = ("data", "bss", "iram", "code", "rodata")
+TOTALS = {"ram": ("data", "bss"), "flash": ("code", "rodata", "data", "iram")}
+
+MAP_START = "Linker script and memory map"
+ARCHIVE_MEMBER = re.compile(r"^(.*?)([^/\\]+)\.a\((.+)\)$")
+HEX = re.compile(r"^0x[0-9a-fA-F]+$")
+
+
+def module_name(path, by_object):
+    path = path.replace("\\", "/")
+    member = ARCHIVE_MEMBER.match(path)
+    if member:
+        archive = member.group(2)
+        archive = archive[3:] if archive.startswith("lib") else archive
+        return "%s(%s)" % (archive, member.group(3)) if by_object else archive
+    marker = path.rfind("/src/")
+    if marker >= 0:
+        name = "src/" + path[marker + 5:]
+        return name[:-2] if name.endswith(".o") else name
+    return os.path.basename(path)
+
+
+def parse(map_path, by_object=False):
+    """Returns {module: {column: bytes}} for every allocated input section in the map."""
+    modules = {}
+    region = None
+    pending = False  # An input section name was on a line of its own; its address and size follow
+    started = False
+    with open(map_path, encoding="utf-8", errors="replace") as f:
+        for line in f:
+            line = line.rstrip("\n")
+            if not started:
+                started = line.startswith(MAP_START)
+                continue
+            if line.startswith("."):
+                region = REGIONS.get(line.split()[0])
+                pending = False
+                continue
+            if region is None or not line.startswith(" "):
+                continue
+            fields = line.split()
+            if not fields:
+                continue
+            if line[1] != " ":
+                if fields[0].startswith("*"):
+                    pending = False  # *fill* padding or a *(pattern) line of the script
+                    continue
+                if len(fields) == 1:
+                    pending = True
+                    continue
+                fields = fields[1:]
+            elif not pending:
+                continue
+            pending = False
+            if len(fields) < 3 or not HEX.match(fields[0]) or not HEX.match(fields[1]):
+                continue
+            size = int(fields[1], 16)
+            if size == 0 or int(fields[0], 16) == 0:
+                continue
+            counts = modules.setdefault(module_name(" ".join(fields[2:]), by_object), dict.fromkeys(COLUMNS, 0))
+            counts[region] += size
+    if not started:
+        raise ValueError("%s is not a GNU ld map file" % map_path)
+    return modules
+
+
+def with_totals(counts):
+    row = dict(counts)
+    for total, parts in TOTALS.items():
+        row[total] = sum(counts.get(part, 0) for part in parts)
+    return row
+
+
+def print_table(rows, sort, top, signed=False):
+    header = COLUMNS + tuple(TOTALS)
+    width = max([len("module")] + [len(name) for name in rows] + [len("total")])
+    number = "%+10d" if signed else "%10d"
+    print(("%-*s" % (width, "module")) + "".join("%10s" % column for column in header))
+    ordered = sorted(rows.items(), key=lambda item: (-abs(item[1][sort]), item[0]))
+    shown, rest = ordered[:top], ordered[top:]
+    if rest:
+        other = dict.fromkeys(header, 0)
+        for _, row in rest:
+            for column in header:
+                other[column] += row[column]
+        shown.append(("(%d more)" % len(rest), other))
+    total = dict.fromkeys(header, 0)
+    for _, row in ordered:
+        for column in header:
+            total[column] += row[column]
+    for name, row in shown + [("total", total)]:
+        print(("%-*s" % (width, name)) + "".join(number % row[column] for column in header))
+
+
+def report(modules, sort="ram", top=30, baseline=None):
+    rows = {name: with_totals(counts) for name, counts in modules.items()}
+    print_table(rows, sort, top)
+    if baseline is None:
+        return
+    before = {name: with_totals(counts) for name, counts in baseline.items()}
+    deltas = {}
+    for name in set(rows) | set(before):
+        new, old = rows.get(name, {}), before.get(name, {})
+        delta = {column: new.get(column, 0) - old.get(column, 0) for column in COLUMNS + tuple(TOTALS)}
+        if any(delta.values()):
+            deltas[name] = delta
+    print()
+    if deltas:
+        print("Change against the baseline:")
+        print_table(deltas, sort, top, signed=True)
+    else:
+        print("No change against the baseline.")
+
+
+def load(path):
+    with open(path) as f:
+        return json.load(f)
+
+
+def save(modules, path):
+    with open(path, "w") as f:
+        json.dump(modules, f, indent=1, sort_keys=True)
+
+
+if __name__ == "__main__":
+    parser = argparse.ArgumentParser(description=__doc__.strip().splitlines()[0])
+    parser.add_argument("map", help="linker map, e.g. .pio/build/esp32dev/firmware.map")
+    parser.add_argument("--sort", choices=COLUMNS + tuple(TOTALS), default="ram", help="column to rank modules by")
+    parser.add_argument("--top", type=int, default=30, help="modules listed before the rest are summed up")
+    parser.add_argument("--by-object", action="store_true", help="list archive members separately")
+    parser.add_argument("--save", help="write the report to this JSON file")
+    parser.add_argument("--compare", help="JSON report to print the change against")
+    args = parser.parse_args()
+    try:
+        modules = parse(args.map, args.by_object)
+    except (OSError, ValueError) as error:
+        sys.exit(str(error))
+    report(modules, args.sort, args.top, load(args.compare) if args.compare else None)
+    if args.save:
+        save(modules, args.save)
+else:
+    Import("env")  # noqa: F821 - provided by PlatformIO
+
+    MAP_PATH = os.path.join(env.subst("$BUILD_DIR"), env.subst("${PROGNAME}.map"))  # noqa: F821
+    env.Append(LINKFLAGS=["-Wl,-Map=" + MAP_PATH])  # noqa: F821
+
+    def footprint(target, source, env):
+        previous = os.path.join(env.subst("$BUILD_DIR"), "footprint.json")
+        modules = parse(MAP_PATH)
+        report(modules, baseline=load(previous) if os.path.isfile(previous) else None)
+        save(modules, previous)
+
+    env.AddCustomTarget(  # noqa: F821
+        name="footprint",
+        dependencies="$BUILD_DIR/${PROGNAME}.elf",
+        actions=footprint,
+        title="Memory footprint",
+        description="Print static DRAM, IRAM and flash use by module, and the change since the last run")
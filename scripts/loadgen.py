@@ -0,0 +1,88 @@
+"""
+Load generator that ramps up concurrent stream clients to find how many one board can drive.
+
+Starts with --start clients and adds --step more every --hold seconds, up to --max. At the end of
+every step it reports, per client, the throughput against the nominal rate, the gaps in the
+sequence numbers and the delay percentiles (see StreamClient in soak_clients.py for how delay is
+measured). A step where any client falls below --min-rate of the nominal rate or its p99 delay
+exceeds --max-delay is marked DEGRADED; the last step before the first one is the ceiling.
+
+    python scripts/loadgen.py 192.168.1.200 --kind sse --max 12
+    python scripts/loadgen.py 192.168.1.200 --kind ws --max 16 --step 2
+
+Event ids are sample sequence numbers, so gaps are exact. Only the standard library is used.
+"""
+
+import argparse
+import sys
+import time
+
+from soak_clients import SseClient, WsClient
+
+
+def percentile(values, percent):
+    if not values:
+        return 0.0
+    values = sorted(values)
+    return values[min(len(values) - 1, int(len(values) * percent / 100))]
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__.strip().splitlines()[0])
+    parser.add_argument("host")
+    parser.add_argument("--port", type=int, default=80)
+    parser.add_argument("--kind", choices=("sse", "ws", "mixed"), default="sse", help="which stream to load")
+    parser.add_argument("--start", type=int, default=1, help="clients in the first step")
+    parser.add_argument("--step", type=int, default=1, help="clients added per step")
+    parser.add_argument("--max", type=int, default=8, help="clients in the last step")
+    parser.add_argument("--hold", type=float, default=30, help="seconds per step")
+    parser.add_argument("--rate", type=float, default=250, help="nominal samples per second (SYNTH_SAMPLE_RATE)")
+    parser.add_argument("--min-rate", type=float, default=0.99, help="fraction of the nominal rate every client must get")
+    parser.add_argument("--max-delay", type=float, default=0.5, help="p99 delay in seconds every client must stay under")
+    args = parser.parse_args()
+
+    clients = []
+    ceiling = 0
+    count = args.start
+    while count <= args.max:
+        while len(clients) < count:
+            use_ws = args.kind == "ws" or (args.kind == "mixed" and len(clients) % 2)
+            kind = WsClient if use_ws else SseClient
+            client = kind(args.host, args.port, "%s%d" % ("ws" if use_ws else "sse", len(clients)), args.rate)
+            client.start()
+            clients.append(client)
+
+        for client in clients:
+            client.take()  # New clients settle during the hold; only count what they get from now on
+        start = time.monotonic()
+        time.sleep(args.hold)
+        elapsed = time.monotonic() - start
+
+        degraded = False
+        lines = []
+        for client in clients:
+            interval = client.take()
+            rate = interval.frames / elapsed
+            p50 = percentile(interval.delays, 50)
+            p99 = percentile(interval.delays, 99)
+            bad = rate < args.rate * args.min_rate or p99 > args.max_delay
+            degraded = degraded or bad
+            lines.append("  %-6s %7.1f/s gaps=%d lost=%d delay p50=%.0fms p99=%.0fms reconnects=%d%s" % (
+                client.name, rate, interval.gaps, interval.gap_frames, p50 * 1000, p99 * 1000,
+                client.reconnects, " <" if bad else ""))
+
+        print("%d clients: %s" % (count, "DEGRADED" if degraded else "ok"))
+        print("\n".join(lines))
+        sys.stdout.flush()
+        if degraded:
+            break
+        ceiling = count
+        count += args.step
+
+    print("ceiling: %d %s clients" % (ceiling, args.kind))
+    for client in clients:
+        client.stop()
+
+
+if __name__ == "__main__":
+    main()
@@ -0,0 +1,134 @@
+"""
+Viewer for the UDP multicast sample stream of an esp32dev_multicast build.
+
+Joins the group, decodes every datagram (a StreamFrameHeader and its raw or delta-encoded
+samples, see StreamFormat.h) and keeps the stream in order by sequence number. A datagram that
+starts behind what was already received arrived late and is dropped; nothing is ever asked for
+again. Every interval it prints the frames received, the late and lost ones and the latest value
+of each channel; --csv also writes every sample as seq,ch0,ch1,...
+
+    python scripts/multicast_viewer.py
+    python scripts/multicast_viewer.py --group 239.255.72.50 --port 47250 --csv trace.csv
+
+The defaults match MULTICAST_GROUP and MULTICAST_PORT. The device advertises both over mDNS as
+_ekgsim._udp. Only the standard library is used.
+"""
+
+import argparse
+import socket
+import struct
+import sys
+import time
+
+HEADER = struct.Struct("<BBHIHBBII")  # StreamFrameHeader
+STREAM_ENCODING_DELTA = 1
+SEQ_HALF_RANGE = 0x80000000
+
+
+def read_varint(data, pos):
+    value = shift = 0
+    while pos < len(data):
+        byte = data[pos]
+        pos += 1
+        value |= (byte & 0x7F) << shift
+        if not byte & 0x80:
+            return value, pos
+        shift += 7
+    raise ValueError("truncated varint")
+
+
+def decode_delta(data, count, channels):
+    """Returns one list per channel; see writeStreamFrameDelta in StreamFormat.cpp."""
+    pos = 0
+    out = []
+    for _ in range(channels):
+        values = []
+        previous = 0
+        while len(values) < count:
+            zigzag, pos = read_varint(data, pos)
+            delta = (zigzag >> 1) ^ -(zigzag & 1)
+            previous = (previous + delta) & 0xFF
+            values.append(previous)
+            if delta == 0:
+                run, pos = read_varint(data, pos)
+                values.extend([previous] * run)
+        out.append(values[:count])
+    return out
+
+
+def decode(datagram):
+    """Returns (seq, channels) for a stream frame, or None for anything else."""
+    if len(datagram) < HEADER.size:
+        return None
+    _, _, _, seq, count, channels, encoding, _, _ = HEADER.unpack_from(datagram)
+    payload = datagram[HEADER.size:]
+    if channels == 0:
+        return None
+    if encoding == STREAM_ENCODING_DELTA:
+        return seq, decode_delta(payload, count, channels)
+    count = min(count, len(payload) // channels)
+    return seq, [list(payload[c:count * channels:channels]) for c in range(channels)]
+
+
+def open_socket(group, port, interface):
+    sock = socket.socket(socket.AF_INET, socket.SOCK_DGRAM, socket.IPPROTO_UDP)
+    sock.setsockopt(socket.SOL_SOCKET, socket.SO_REUSEADDR, 1)
+    sock.bind(("", port))
+    membership = socket.inet_aton(group) + socket.inet_aton(interface)
+    sock.setsockopt(socket.IPPROTO_IP, socket.IP_ADD_MEMBERSHIP, membership)
+    sock.settimeout(1.0)
+    return sock
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__.strip().splitlines()[0])
+    parser.add_argument("--group", default="239.255.72.50", help="multicast group (MULTICAST_GROUP)")
+    parser.add_argument("--port", type=int, default=47250, help="UDP port (MULTICAST_PORT)")
+    parser.add_argument("--interface", default="0.0.0.0", help="address of the local interface to join on")
+    parser.add_argument("--interval", type=float, default=5, help="seconds between reports")
+    parser.add_argument("--csv", help="file to write every sample to")
+    args = parser.parse_args()
+
+    sock = open_socket(args.group, args.port, args.interface)
+    csv = open(args.csv, "w") if args.csv else None
+    next_seq = None
+    frames = late = lost = 0
+    latest = []
+    last = time.monotonic()
+    while True:
+        try:
+            datagram = sock.recv(2048)
+        except socket.timeout:
+            datagram = None
+        if datagram:
+            try:
+                frame = decode(datagram)
+            except ValueError:
+                frame = None
+            if frame is not None and frame[1] and frame[1][0]:
+                seq, channels = frame
+                count = len(channels[0])
+                behind = 0 if next_seq is None else (next_seq - seq) & 0xFFFFFFFF
+                if 0 < behind < SEQ_HALF_RANGE:
+                    late += 1  # Overtaken by a later datagram; too late to draw
+                else:
+                    if behind:
+                        lost += 0x100000000 - behind
+                    next_seq = (seq + count) & 0xFFFFFFFF
+                    frames += count
+                    latest = [channel[-1] for channel in channels]
+                    if csv:
+                        for i in range(count):
+                            csv.write("%d,%s\n" % ((seq + i) & 0xFFFFFFFF, ",".join(str(ch[i]) for ch in channels)))
+
+        now = time.monotonic()
+        if now - last >= args.interval:
+            print("%.1f frames/s, %d late datagrams, %d frames lost, latest %s" % (
+                frames / (now - last), late, lost, latest))
+            sys.stdout.flush()
+            frames = late = lost = 0
+            last = now
+
+
+if __name__ == "__main__":
+    main()
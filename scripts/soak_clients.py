@@ -0,0 +1,271 @@
+"""
+Soak test clients for the sample stream.
+
+Opens N /events and M /ws connections to the device and keeps reading them for as long as the
+run lasts. Every interval it prints what each client received against the nominal sample rate,
+which is its drop rate, the gaps in its sequence numbers, and the device's free heap from /metrics,
+relative to the first scrape.
+Run it next to the serial monitor of an esp32dev_soak build, which reports the device side:
+
+    python scripts/soak_clients.py 192.168.1.200 --sse 4 --ws 4 --hours 8
+
+--resume-check is a one-off regression check of the /events catch-up instead: it reconnects with a
+Last-Event-ID that many frames behind the stream and fails unless every frame from there on arrives,
+in order, until the stream is a second past where it was:
+
+    python scripts/soak_clients.py 192.168.1.200 --resume-check 1024
+
+Only the standard library is used.
+"""
+
+import argparse
+import base64
+import json
+import os
+import re
+import socket
+import struct
+import sys
+import threading
+import time
+import urllib.request
+
+FRAME_HEADER_SIZE = 20  # StreamFrameHeader
+HEAP_METRIC = re.compile(r"^ekgsim_heap_free_bytes (\d+)$", re.M)
+
+
+class Interval:
+    """What one client received since the previous report."""
+
+    def __init__(self):
+        self.frames = 0
+        self.gaps = 0
+        self.gap_frames = 0
+        self.delays = []
+
+
+class StreamClient(threading.Thread):
+    """Base class: counts the frames received and checks that their sequence numbers are contiguous.
+
+    Every message carries the sequence number of its first frame, so the next one must start where
+    the previous one ended. Anything else is a gap; frames skipped over count as lost.
+
+    The delay of a message is how late it arrived compared with the earliest any client has seen a
+    frame, after lining up sequence numbers with the nominal rate. It covers queueing on the device
+    and on the network, not the fixed part of the path, and assumes runs short enough that the two
+    clocks do not drift apart noticeably.
+    """
+
+    baseline = None  # Smallest arrival time minus seq / rate seen by any client
+    baseline_lock = threading.Lock()
+
+    def __init__(self, host, port, name, rate):
+        super().__init__(daemon=True)
+        self.host = host
+        self.port = port
+        self.name = name
+        self.rate = rate
+        self.next_seq = None
+        self.interval = Interval()
+        self.reconnects = 0
+        self.lock = threading.Lock()
+        self.stopped = False
+
+    def count(self, seq, frames):
+        with self.lock:
+            if self.next_seq is None:
+                # The first message of a connection starts the device's catch-up from its history
+                self.next_seq = (seq + frames) & 0xFFFFFFFF
+                return
+            behind = (self.next_seq - seq) & 0xFFFFFFFF
+            if 0 < behind < 0x80000000:
+                # Starts before what was already received, as live events next to a catch-up do
+                if behind >= frames:
+                    return
+                frames -= behind
+            elif behind:
+                self.interval.gaps += 1
+                self.interval.gap_frames += 0x100000000 - behind
+            self.next_seq = (seq + frames + (behind if behind < 0x80000000 else 0)) & 0xFFFFFFFF
+            self.interval.frames += frames
+        offset = time.monotonic() - seq / self.rate
+        with StreamClient.baseline_lock:
+            if StreamClient.baseline is None or offset < StreamClient.baseline:
+                StreamClient.baseline = offset
+            delay = offset - StreamClient.baseline
+        with self.lock:
+            self.interval.delays.append(delay)
+
+    def take(self):
+        with self.lock:
+            interval, self.interval = self.interval, Interval()
+        return interval
+
+    def stop(self):
+        self.stopped = True
+
+    def run(self):
+        while not self.stopped:
+            self.next_seq = None  # A new connection starts wherever the stream is now
+            try:
+                with socket.create_connection((self.host, self.port), timeout=10) as sock:
+                    self.stream(sock)
+            except OSError:
+                pass
+            self.reconnects += 1
+            time.sleep(1)
+
+
+def events_request(host, last_event_id=None):
+    resume = b"Last-Event-ID: %d\r\n" % last_event_id if last_event_id is not None else b""
+    return b"GET /events HTTP/1.1\r\nHost: %s\r\nAccept: text/event-stream\r\n%s\r\n" % (host.encode(), resume)
+
+
+def read_events(reader):
+    """Yields the sequence number of the first frame and the number of frames of every "value" and "values" event.
+
+    Event ids are the sequence number just past the event's last frame.
+    """
+    event = None
+    end = 0
+    for line in reader:
+        line = line.rstrip(b"\r\n")
+        if line.startswith(b"id: "):
+            end = int(line[4:])
+        elif line.startswith(b"event: "):
+            event = line[7:]
+        elif line.startswith(b"data: ") and event == b"values":
+            data = json.loads(line[6:])
+            frames = len(data["ch"][0]) * data.get("dt", 1)
+            yield (end - frames) & 0xFFFFFFFF, frames
+        elif line.startswith(b"data: ") and event == b"value":
+            yield (end - 1) & 0xFFFFFFFF, 1
+
+
+class SseClient(StreamClient):
+    """Reads /events and counts the frames in "value" and "values" events."""
+
+    def stream(self, sock):
+        sock.sendall(events_request(self.host))
+        for seq, frames in read_events(sock.makefile("rb")):
+            if self.stopped:
+                return
+            self.count(seq, frames)
+
+
+class WsClient(StreamClient):
+    """Reads /ws and counts the frames announced in each binary message's header."""
+
+    def stream(self, sock):
+        key = base64.b64encode(os.urandom(16))
+        sock.sendall(b"GET /ws HTTP/1.1\r\nHost: %s\r\nUpgrade: websocket\r\nConnection: Upgrade\r\n"
+                     b"Sec-WebSocket-Key: %s\r\nSec-WebSocket-Version: 13\r\n\r\n" % (self.host.encode(), key))
+        reader = sock.makefile("rb")
+        while reader.readline() not in (b"\r\n", b""):
+            pass
+        while not self.stopped:
+            head = reader.read(2)
+            if len(head) < 2:
+                return
+            opcode, length = head[0] & 0x0F, head[1] & 0x7F
+            if length == 126:
+                length = struct.unpack("!H", reader.read(2))[0]
+            elif length == 127:
+                length = struct.unpack("!Q", reader.read(8))[0]
+            payload = reader.read(length)
+            if opcode == 0x8:
+                return
+            if opcode == 0x2 and len(payload) >= FRAME_HEADER_SIZE:
+                self.count(*struct.unpack_from("<IH", payload, 4))
+
+
+def resume_check(host, port, back, rate, settle=2.0):
+    """Reconnects /events with a Last-Event-ID @back frames behind the stream; True if every frame since arrives in order.
+
+    The first connection is read for @settle seconds, long enough for its own catch-up to end, so its
+    last event id is where the live stream is.
+    """
+    with socket.create_connection((host, port), timeout=10) as sock:
+        sock.sendall(events_request(host))
+        deadline = time.monotonic() + settle
+        for seq, frames in read_events(sock.makefile("rb")):
+            live = (seq + frames) & 0xFFFFFFFF
+            if time.monotonic() > deadline:
+                break
+        else:
+            print("FAIL: /events closed before the catch-up ended")
+            return False
+
+    start = (live - back) & 0xFFFFFFFF
+    until = (live + int(rate)) & 0xFFFFFFFF
+    expected = start
+    with socket.create_connection((host, port), timeout=10) as sock:
+        sock.sendall(events_request(host, start))
+        for seq, frames in read_events(sock.makefile("rb")):
+            if seq != expected:
+                print("FAIL: resumed from %d, expected frame %d but got an event starting at %d" % (start, expected, seq))
+                return False
+            expected = (expected + frames) & 0xFFFFFFFF
+            if (expected - until) & 0xFFFFFFFF < 0x80000000:
+                print("OK: resumed from %d and got all %d frames since, in order" % (start, (expected - start) & 0xFFFFFFFF))
+                return True
+    print("FAIL: /events closed at frame %d, resumed from %d" % (expected, start))
+    return False
+
+
+def scrape_heap(host, port):
+    try:
+        with urllib.request.urlopen("http://%s:%d/metrics" % (host, port), timeout=5) as response:
+            match = HEAP_METRIC.search(response.read().decode())
+            return int(match.group(1)) if match else None
+    except OSError:
+        return None
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__.strip().splitlines()[0])
+    parser.add_argument("host")
+    parser.add_argument("--port", type=int, default=80)
+    parser.add_argument("--sse", type=int, default=2, help="number of /events clients")
+    parser.add_argument("--ws", type=int, default=2, help="number of /ws clients")
+    parser.add_argument("--rate", type=float, default=250, help="nominal samples per second (SYNTH_SAMPLE_RATE)")
+    parser.add_argument("--interval", type=float, default=60, help="seconds between reports")
+    parser.add_argument("--hours", type=float, default=1, help="length of the run")
+    parser.add_argument("--resume-check", type=int, metavar="FRAMES",
+                        help="only check that an /events reconnect this many frames back gets every frame, then exit")
+    args = parser.parse_args()
+
+    if args.resume_check is not None:
+        try:
+            sys.exit(0 if resume_check(args.host, args.port, args.resume_check, args.rate) else 1)
+        except OSError as error:
+            sys.exit("FAIL: %s" % error)
+
+    clients = [SseClient(args.host, args.port, "sse%d" % i, args.rate) for i in range(args.sse)]
+    clients += [WsClient(args.host, args.port, "ws%d" % i, args.rate) for i in range(args.ws)]
+    for client in clients:
+        client.start()
+
+    baseline = None
+    start = last = time.monotonic()
+    while time.monotonic() - start < args.hours * 3600:
+        time.sleep(args.interval)
+        now = time.monotonic()
+        elapsed, last = now - last, now
+        expected = args.rate * elapsed
+        rates = []
+        for client in clients:
+            interval = client.take()
+            rates.append("%s=%.1f/s(%.2f%% drop, %d gaps, %d reconnects)" % (
+                client.name, interval.frames / elapsed, max(0.0, 100.0 * (1 - interval.frames / expected)),
+                interval.gaps, client.reconnects))
+        heap = scrape_heap(args.host, args.port)
+        if baseline is None:
+            baseline = heap
+        drift = heap - baseline if heap is not None and baseline is not None else 0
+        print("t=%ds heap=%s drift=%d %s" % (now - start, heap, drift, " ".join(rates)))
+        sys.stdout.flush()
+
+
+if __name__ == "__main__":
+    main()
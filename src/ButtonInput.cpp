@@ -0,0 +1,71 @@
+/**
+ * @file ButtonInput.cpp
+ * @brief Implementation of the debounced push buttons.
+ */
+
+#include "ButtonInput.h"
+
+/**
+ * @brief Constructs a button on the given pin; nothing is touched until begin().
+ *
+ * @param pin GPIO the button pulls to ground.
+ */
+DebouncedButton::DebouncedButton(uint8_t pin)
+    : _pin(pin), _level(HIGH), _timer(nullptr), _presses(0)
+{
+}
+
+/**
+ * @brief Enables the pull-up, creates the debounce timer and attaches the interrupt on both edges.
+ *
+ * @return true if the timer was created and the button is live.
+ */
+bool DebouncedButton::begin()
+{
+    pinMode(_pin, INPUT_PULLUP);
+    _level = digitalRead(_pin);
+    _timer = xTimerCreate("button", pdMS_TO_TICKS(BUTTON_DEBOUNCE_MS), pdFALSE, this, onSettled);
+    if (_timer == nullptr)
+    {
+        Serial.println("Failed to create button debounce timer");
+        return false;
+    }
+    attachInterruptArg(_pin, onEdge, this, CHANGE);
+    return true;
+}
+
+/**
+ * @brief Restarts the debounce window on every edge, so the timer only fires once the contacts settle.
+ *
+ * @param arg The button.
+ */
+void IRAM_ATTR DebouncedButton::onEdge(void *arg)
+{
+    DebouncedButton *button = static_cast<DebouncedButton *>(arg);
+    BaseType_t woken = pdFALSE;
+    xTimerResetFromISR(button->_timer, &woken);
+    if (woken)
+    {
+        portYIELD_FROM_ISR();
+    }
+}
+
+/**
+ * @brief Reads the settled level and counts a press on each transition to LOW.
+ *
+ * @param timer The button's debounce timer.
+ */
+void DebouncedButton::onSettled(TimerHandle_t timer)
+{
+    DebouncedButton *button = static_cast<DebouncedButton *>(pvTimerGetTimerID(timer));
+    const bool level = digitalRead(button->_pin);
+    if (level == button->_level)
+    {
+        return; // A bounce that ended where it started
+    }
+    button->_level = level;
+    if (level == LOW)
+    {
+        button->_presses.fetch_add(1, std::memory_order_relaxed); // Not load/store: takePresses() writes it too
+    }
+}
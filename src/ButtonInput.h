@@ -0,0 +1,45 @@
+/**
+ * @file ButtonInput.h
+ * @brief Interrupt-driven, timer-debounced front panel push buttons.
+ *
+ * Every edge on a button pin restarts a one-shot FreeRTOS timer from the GPIO interrupt. Only when
+ * the pin has been quiet for BUTTON_DEBOUNCE_MS does the timer read the settled level, so contact
+ * bounce never reaches the application and nothing polls the pins while no button is touched.
+ * Presses are counted in an atomic that the consumer drains whenever it is ready to act on them.
+ */
+
+#ifndef ButtonInput_h
+#define ButtonInput_h
+
+#include <Arduino.h>
+#include <atomic>
+#include <freertos/FreeRTOS.h>
+#include <freertos/timers.h>
+
+#ifndef BUTTON_DEBOUNCE_MS
+#define BUTTON_DEBOUNCE_MS 50 ///< Time a pin must stay quiet before its level is accepted.
+#endif
+
+/**
+ * @class DebouncedButton
+ * @brief One active-low push button on a pin with the internal pull-up.
+ */
+class DebouncedButton
+{
+public:
+    explicit DebouncedButton(uint8_t pin);
+
+    bool begin(); ///< Configures the pin, creates the debounce timer and attaches the edge interrupt.
+    uint32_t takePresses() { return _presses.exchange(0, std::memory_order_relaxed); } ///< Presses since the previous call.
+
+private:
+    static void IRAM_ATTR onEdge(void *arg); ///< GPIO interrupt; restarts the debounce timer.
+    static void onSettled(TimerHandle_t timer); ///< Debounce timer expiry; runs in the timer service task.
+
+    uint8_t _pin; ///< GPIO the button pulls to ground.
+    bool _level; ///< Last settled level; timer service task only.
+    TimerHandle_t _timer; ///< One-shot debounce timer.
+    std::atomic<uint32_t> _presses; ///< Settled presses not yet taken.
+};
+
+#endif
@@ -0,0 +1,200 @@
+/**
+ * @file ClientFlow.cpp
+ * @brief Implementation of the per-client congestion level and min/max decimator.
+ */
+
+#include "ClientFlow.h"
+
+static_assert(FLOW_MAX_LEVEL < 8, "ticksPerValue() must fit in a uint8_t");
+static_assert(FLOW_PENDING_MAX % 2 == 0, "decimated values are produced in min/max pairs");
+
+/**
+ * @brief Assigns this slot to a client and starts it at full rate, with nothing to catch up.
+ *
+ * @param client The client to track, or nullptr to free the slot.
+ * @param clientId The client's id(), 0 when freeing the slot.
+ */
+void ClientFlow::reset(AsyncEventSourceClient *client, uint32_t clientId)
+{
+    _client = client;
+    _clientId = clientId;
+    _level = 0;
+    _calmBatches = 0;
+    _batchesSinceFlush = 0;
+    _bucketFill = 0;
+    _pendingCount = 0;
+    _pendingSeq = 0;
+    _bucketSeq = 0;
+    _catchingUp = false;
+    _catchUpSeq = 0;
+    _samplesSent.store(0, std::memory_order_relaxed);
+    _samplesDropped.store(0, std::memory_order_relaxed);
+}
+
+/**
+ * @brief Works out the decimation level from the client's backlog.
+ *
+ * Congestion raises the level by one step per batch. The level only drops again after the queue has
+ * stayed empty for FLOW_CALM_BATCHES batches in a row, so a client on a marginal link does not flap.
+ *
+ * @param queued Messages waiting in the client's SSE queue.
+ * @param space Free bytes in the client's TCP send buffer.
+ * @param recordLen Size of the next full-rate record.
+ * @return The level the client should be at for this batch.
+ */
+uint8_t ClientFlow::nextLevel(size_t queued, size_t space, size_t recordLen)
+{
+    if (queued >= FLOW_QUEUE_HIGH || space < recordLen)
+    {
+        _calmBatches = 0;
+        return _level < FLOW_MAX_LEVEL ? _level + 1 : _level;
+    }
+    if (queued > 0 || _level == 0)
+    {
+        _calmBatches = 0;
+        return _level;
+    }
+    if (++_calmBatches < FLOW_CALM_BATCHES)
+    {
+        return _level;
+    }
+    _calmBatches = 0;
+    return _level - 1;
+}
+
+/**
+ * @brief Switches the decimation level.
+ *
+ * Pending frames keep the old timing and a partial bucket's size depends on it, so send both, pending
+ * frames first and then takeBucket(), before calling this. A bucket still partial here is discarded.
+ *
+ * @param level New decimation level, at most FLOW_MAX_LEVEL.
+ */
+void ClientFlow::setLevel(uint8_t level)
+{
+    _level = level > FLOW_MAX_LEVEL ? FLOW_MAX_LEVEL : level;
+    _bucketFill = 0;
+    _batchesSinceFlush = 0;
+}
+
+/**
+ * @brief Empties the partial bucket as full-rate frames, so it survives a level change.
+ *
+ * A partial bucket holds fewer frames than a decimated value stands for at the current level, so it is
+ * expanded at one frame per tick instead: its first extreme held for the first half of the frames it
+ * covers and the second extreme for the rest. Its extremes and its length in ticks are both kept.
+ *
+ * @param[out] out At least BUCKET_MAX frames.
+ * @param[out] seq Sequence number of the first source frame of the bucket.
+ * @return Frames written, 0 if no bucket was started.
+ */
+size_t ClientFlow::takeBucket(SampleFrame *out, uint32_t &seq)
+{
+    const size_t fill = _bucketFill;
+    const size_t firstHalf = (fill + 1) / 2;
+    _bucketFill = 0;
+    seq = _bucketSeq;
+    for (size_t i = 0; i < fill; i++)
+    {
+        for (size_t c = 0; c < CHANNEL_COUNT; c++)
+        {
+            out[i].ch[c] = (i < firstHalf) == _minFirst[c] ? _min.ch[c] : _max.ch[c];
+        }
+    }
+    return fill;
+}
+
+/**
+ * @brief Decimates a batch of frames into the pending buffer.
+ *
+ * Frames are grouped into buckets of 2^(level + 1). Each bucket produces two values per channel, its
+ * minimum and its maximum in the order they occurred, so each value stands for 2^level source frames.
+ * A send is requested once the buffer is full or 2^level batches have been coalesced.
+ *
+ * @param frames Full-rate frames, oldest first.
+ * @param count Number of frames.
+ * @param seq Sequence number of the first frame.
+ * @return true when the pending frames should be sent now.
+ */
+bool ClientFlow::push(const SampleFrame *frames, size_t count, uint32_t seq)
+{
+    const uint8_t bucketSize = 2 << _level;
+    for (size_t i = 0; i < count; i++)
+    {
+        const SampleFrame &frame = frames[i];
+        if (_bucketFill == 0)
+        {
+            _bucketSeq = seq + i;
+            _min = frame;
+            _max = frame;
+            for (size_t c = 0; c < CHANNEL_COUNT; c++)
+            {
+                _minFirst[c] = true;
+            }
+        }
+        else
+        {
+            for (size_t c = 0; c < CHANNEL_COUNT; c++)
+            {
+                if (frame.ch[c] < _min.ch[c])
+                {
+                    _min.ch[c] = frame.ch[c];
+                    _minFirst[c] = false; // Newest extreme, so it goes last
+                }
+                else if (frame.ch[c] > _max.ch[c])
+                {
+                    _max.ch[c] = frame.ch[c];
+                    _minFirst[c] = true;
+                }
+            }
+        }
+
+        if (++_bucketFill < bucketSize)
+        {
+            continue;
+        }
+        _bucketFill = 0;
+        if (_pendingCount + 2 > FLOW_PENDING_MAX)
+        {
+            continue; // Caller did not flush; drop the bucket rather than overrun
+        }
+        if (_pendingCount == 0)
+        {
+            _pendingSeq = _bucketSeq;
+        }
+        SampleFrame &first = _pending[_pendingCount++];
+        SampleFrame &second = _pending[_pendingCount++];
+        for (size_t c = 0; c < CHANNEL_COUNT; c++)
+        {
+            first.ch[c] = _minFirst[c] ? _min.ch[c] : _max.ch[c];
+            second.ch[c] = _minFirst[c] ? _max.ch[c] : _min.ch[c];
+        }
+    }
+
+    if (_pendingCount == 0)
+    {
+        return false;
+    }
+    return ++_batchesSinceFlush >= (1 << _level) || _pendingCount + 2 > FLOW_PENDING_MAX;
+}
+
+/**
+ * @brief Counts the source frames carried by one message.
+ *
+ * @param frames Source frames the message stands for; decimated values count ticksPerValue() each.
+ * @param queued Whether the client's queue accepted the message.
+ */
+void ClientFlow::recordSend(size_t frames, bool queued)
+{
+    std::atomic<uint32_t> &counter = queued ? _samplesSent : _samplesDropped;
+    counter.store(counter.load(std::memory_order_relaxed) + frames, std::memory_order_relaxed);
+}
+
+/**
+ * @brief Empties the pending buffer after it has been sent.
+ */
+void ClientFlow::clearPending()
+{
+    _pendingCount = 0;
+    _batchesSinceFlush = 0;
+}
@@ -0,0 +1,92 @@
+/**
+ * @file ClientFlow.h
+ * @brief Per-client flow control for the SSE stream.
+ *
+ * Each connected client gets a decimation level. At level 0 it shares the full-rate broadcast. When its
+ * queue backs up the level rises, and the client instead receives peak-preserving min/max decimated
+ * values that are coalesced into fewer, larger events. Sharp features such as the QRS complex survive
+ * because every bucket keeps both of its extremes.
+ *
+ * A client that just joined is first caught up from the sample history: the slot keeps the sequence
+ * number it needs next until the catch-up reaches the live stream.
+ */
+
+#ifndef ClientFlow_h
+#define ClientFlow_h
+
+#include <Arduino.h>
+#include <atomic>
+#include "SampleFrame.h"
+
+#ifndef FLOW_QUEUE_HIGH
+#define FLOW_QUEUE_HIGH 8 ///< Queued messages at or above which a client counts as congested.
+#endif
+#ifndef FLOW_CALM_BATCHES
+#define FLOW_CALM_BATCHES 25 ///< Consecutive batches with an empty queue before the level drops again.
+#endif
+#ifndef FLOW_MAX_LEVEL
+#define FLOW_MAX_LEVEL 3 ///< Highest decimation level; level L keeps 2 of every 2^(L+1) frames.
+#endif
+#ifndef FLOW_PENDING_MAX
+#define FLOW_PENDING_MAX 32 ///< Decimated frames held per client before they must be sent.
+#endif
+
+class AsyncEventSourceClient;
+
+/**
+ * @class ClientFlow
+ * @brief Congestion level and min/max decimator for one SSE client.
+ */
+class ClientFlow
+{
+public:
+    static constexpr size_t BUCKET_MAX = 2 << FLOW_MAX_LEVEL; ///< Frames in a bucket at the highest level.
+
+    ClientFlow() { reset(nullptr, 0); } ///< Constructor leaves the slot unassigned.
+
+    void reset(AsyncEventSourceClient *client, uint32_t clientId); ///< Assigns the slot to @p client, whose id() is @p clientId, at full rate.
+    AsyncEventSourceClient *client() const { return _client; } ///< Client this slot belongs to, or nullptr.
+    bool belongsTo(const AsyncEventSourceClient *client, uint32_t clientId) const { return _client == client && _clientId == clientId; } ///< Also false for a new client at a freed client's address.
+
+    uint8_t nextLevel(size_t queued, size_t space, size_t recordLen); ///< Level the client should be at now.
+    uint8_t level() const { return _level; } ///< Current decimation level, 0 = full rate.
+    void setLevel(uint8_t level); ///< Switches level. Flush pending frames and the partial bucket first.
+    size_t takeBucket(SampleFrame *out, uint32_t &seq); ///< Empties the partial bucket into at most BUCKET_MAX full-rate frames.
+
+    bool push(const SampleFrame *frames, size_t count, uint32_t seq); ///< Decimates @p frames; true when pending frames should be sent.
+    const SampleFrame *pending() const { return _pending; } ///< Decimated frames waiting to be sent.
+    uint32_t pendingSeq() const { return _pendingSeq; } ///< Sequence number of the first source frame behind pending().
+    size_t pendingCount() const { return _pendingCount; } ///< Number of decimated frames waiting to be sent.
+    uint8_t ticksPerValue() const { return 1 << _level; } ///< Source frames each decimated value stands for.
+    void clearPending(); ///< Marks the pending frames as sent.
+
+    void beginCatchUp(uint32_t from) { _catchingUp = true; _catchUpSeq = from; } ///< Starts catching the client up from @p from.
+    bool catchingUp() const { return _catchingUp; } ///< Whether live frames must wait for the catch-up.
+    uint32_t catchUpSeq() const { return _catchUpSeq; } ///< Sequence number the catch-up sends next.
+    void advanceCatchUp(uint32_t next, bool done) { _catchUpSeq = next; _catchingUp = !done; } ///< Records how far the catch-up got.
+
+    void recordSend(size_t frames, bool queued); ///< Counts @p frames as sent, or as dropped if the queue refused them.
+    uint32_t samplesSent() const { return _samplesSent.load(std::memory_order_relaxed); } ///< Source frames delivered to the queue.
+    uint32_t samplesDropped() const { return _samplesDropped.load(std::memory_order_relaxed); } ///< Source frames the queue refused.
+
+private:
+    AsyncEventSourceClient *_client; ///< Owner of this slot.
+    uint32_t _clientId; ///< id() of the owner.
+    uint8_t _level; ///< Current decimation level.
+    uint8_t _calmBatches; ///< Consecutive batches seen with an empty queue.
+    uint8_t _batchesSinceFlush; ///< Batches pushed since the pending frames were last cleared.
+    uint8_t _bucketFill; ///< Frames accumulated in the current bucket.
+    SampleFrame _min; ///< Per-channel minimum of the current bucket.
+    SampleFrame _max; ///< Per-channel maximum of the current bucket.
+    bool _minFirst[CHANNEL_COUNT]; ///< Whether the minimum occurred before the maximum, per channel.
+    SampleFrame _pending[FLOW_PENDING_MAX]; ///< Decimated output waiting to be sent.
+    size_t _pendingCount; ///< Number of valid entries in _pending.
+    uint32_t _pendingSeq; ///< Sequence number of the first source frame of _pending[0].
+    uint32_t _bucketSeq; ///< Sequence number of the first source frame of the current bucket.
+    bool _catchingUp; ///< Whether the client still gets its frames from the history.
+    uint32_t _catchUpSeq; ///< Next sequence number of the catch-up.
+    std::atomic<uint32_t> _samplesSent; ///< Read by the /metrics handler.
+    std::atomic<uint32_t> _samplesDropped; ///< Read by the /metrics handler.
+};
+
+#endif
@@ -0,0 +1,294 @@
+/**
+ * @file ControlApi.cpp
+ * @brief Implementation of the control endpoints and the scenario compiler.
+ */
+
+#include "ControlApi.h"
+#include "RemoteControl.h"
+#include "IdleMode.h"
+#include "StreamFormat.h"
+#include "WaveformSynth.h"
+#include "WavePack.h"
+#include <ArduinoJson.h>
+
+#define CONTROL_STR_(x) #x
+#define CONTROL_STR(x) CONTROL_STR_(x) ///< Spells out a numeric macro in an error message.
+
+// Scenarios are compiled here before being handed over; only used from the async_tcp task
+static ScenarioStep compiledSteps[SCENARIO_MAX_STEPS];
+
+/**
+ * @brief Collects a request body into request->_tempObject, NUL-terminated; the request frees it.
+ */
+static void collectBody(AsyncWebServerRequest *request, uint8_t *data, size_t len, size_t index, size_t total)
+{
+    if (total > CONTROL_BODY_MAX)
+    {
+        return;
+    }
+    if (index == 0)
+    {
+        request->_tempObject = malloc(total + 1);
+    }
+    if (request->_tempObject == nullptr)
+    {
+        return;
+    }
+    memcpy((uint8_t *)request->_tempObject + index, data, len);
+    if (index + len == total)
+    {
+        ((char *)request->_tempObject)[total] = '\0';
+    }
+}
+
+/**
+ * @brief Parses the collected body, answering the request itself when there is none or it is not JSON.
+ *
+ * @return true if @p doc holds the body.
+ */
+static bool parseBody(AsyncWebServerRequest *request, JsonDocument &doc)
+{
+    if (request->_tempObject == nullptr)
+    {
+        request->send(request->contentLength() > CONTROL_BODY_MAX ? 413 : 400, "text/plain", "Expected a JSON body");
+        return false;
+    }
+    DeserializationError error = deserializeJson(doc, (const char *)request->_tempObject);
+    if (error)
+    {
+        request->send(400, "text/plain", String("Invalid JSON: ") + error.c_str());
+        return false;
+    }
+    return true;
+}
+
+/**
+ * @brief Reads the control fields of a JSON object into a ControlSet.
+ *
+ * @param json Object with any of "bpm", "amp", "mode" and "alive".
+ * @param control Receives the fields present.
+ * @return nullptr on success, or what is wrong with @p json.
+ */
+static const char *parseControl(JsonObjectConst json, ControlSet &control)
+{
+    control = ControlSet{ 0, 0, 0, 0, 0 };
+    if (json.isNull())
+    {
+        return "expected a JSON object";
+    }
+    if (!json["bpm"].isNull())
+    {
+        const int bpm = json["bpm"] | -1;
+        if (bpm != 0 && (bpm < BPM_MIN || bpm > BPM_MAX))
+        {
+            return "bpm must be 0 or between " CONTROL_STR(BPM_MIN) " and " CONTROL_STR(BPM_MAX);
+        }
+        control.set |= CONTROL_SET_BPM;
+        control.bpm = bpm;
+    }
+    if (!json["amp"].isNull())
+    {
+        const int amp = json["amp"] | -1;
+        if (amp != 0 && (amp < AMP_MIN || amp > AMP_MAX))
+        {
+            return "amp must be 0 or between " CONTROL_STR(AMP_MIN) " and " CONTROL_STR(AMP_MAX);
+        }
+        control.set |= CONTROL_SET_AMP;
+        control.amp = amp;
+    }
+    if (!json["mode"].isNull())
+    {
+        const char *mode = json["mode"] | "";
+        if (strcmp(mode, "ekg") != 0 && strcmp(mode, "ary") != 0)
+        {
+            return "mode must be \"ekg\" or \"ary\"";
+        }
+        control.set |= CONTROL_SET_EKG;
+        control.state |= strcmp(mode, "ekg") == 0 ? CONTROL_EKG : 0;
+    }
+    if (!json["alive"].isNull())
+    {
+        if (!json["alive"].is<bool>())
+        {
+            return "alive must be true or false";
+        }
+        control.set |= CONTROL_SET_ALIVE;
+        control.state |= json["alive"].as<bool>() ? CONTROL_ALIVE : 0;
+    }
+    if (!json["rhythm"].isNull())
+    {
+        const char *rhythm = json["rhythm"] | "";
+        const int index = rhythm[0] ? wavePack.find(rhythm) : -1;
+        if (rhythm[0] && index < 0)
+        {
+            return "rhythm is not in the waveform pack, see /api/rhythms";
+        }
+        control.set |= CONTROL_SET_RHYTHM;
+        control.rhythm = index + 1;
+    }
+    return nullptr;
+}
+
+/**
+ * @brief Converts milliseconds of scenario time to samples at SYNTH_SAMPLE_RATE.
+ */
+static uint32_t msToSamples(uint32_t ms)
+{
+    return ((uint64_t)ms * SYNTH_SAMPLE_RATE) / 1000;
+}
+
+/**
+ * @brief Checks a scenario and compiles it into compiledSteps.
+ *
+ * @param json The uploaded document.
+ * @param count Receives the number of steps.
+ * @param loopAt Receives the loop length in samples, 0 to play once.
+ * @return nullptr on success, or what is wrong with the scenario.
+ */
+static const char *compileScenario(const JsonDocument &json, size_t &count, uint32_t &loopAt)
+{
+    JsonArrayConst steps = json["steps"];
+    if (steps.isNull())
+    {
+        return "steps must be an array";
+    }
+    if (steps.size() > SCENARIO_MAX_STEPS)
+    {
+        return "too many steps, the most is " CONTROL_STR(SCENARIO_MAX_STEPS);
+    }
+
+    count = 0;
+    uint32_t lastMs = 0;
+    for (JsonObjectConst step : steps)
+    {
+        if (!step["at"].is<uint32_t>())
+        {
+            return "every step needs \"at\", in milliseconds";
+        }
+        const uint32_t atMs = step["at"];
+        if (atMs < lastMs)
+        {
+            return "steps must be in ascending \"at\" order";
+        }
+        lastMs = atMs;
+        ScenarioStep &compiled = compiledSteps[count++];
+        const char *error = parseControl(step, compiled.control);
+        if (error != nullptr)
+        {
+            return error;
+        }
+        compiled.atSample = msToSamples(atMs);
+    }
+
+    loopAt = msToSamples(json["loopMs"] | 0u);
+    if (loopAt != 0 && loopAt <= msToSamples(lastMs))
+    {
+        return "loopMs must come after the last step";
+    }
+    return nullptr;
+}
+
+/**
+ * @brief Sends the parameters in use, the overrides and the scenario position as JSON.
+ */
+static void sendState(AsyncWebServerRequest *request)
+{
+    const uint32_t state = remoteControl.state();
+    const ControlSet overrides = remoteControl.overrides();
+    AsyncResponseStream *response = request->beginResponseStream("application/json");
+    const char *rhythm = wavePack.name((state >> 24) - 1);
+    response->printf("{\"bpm\":%u,\"amp\":%u,\"mode\":\"%s\",\"alive\":%s,\"rhythm\":\"%s\",\"override\":{\"bpm\":%u,\"amp\":%u},\"scenario\":{\"steps\":%u,\"next\":%u}}",
+                     (unsigned)(state & 0xFF), (unsigned)((state >> 8) & 0xFF), ((state >> 16) & CONTROL_EKG) ? "ekg" : "ary", ((state >> 16) & CONTROL_ALIVE) ? "true" : "false",
+                     rhythm ? rhythm : "", overrides.bpm, overrides.amp, remoteControl.scenarioSteps(), remoteControl.scenarioNext());
+    request->send(response);
+}
+
+/**
+ * @brief Adds the control handlers.
+ *
+ * @param server The web server.
+ */
+void addControlRoutes(AsyncWebServer &server)
+{
+    server.on("/api/control", HTTP_GET, sendState);
+
+    server.on("/api/rhythms", HTTP_GET, [](AsyncWebServerRequest *request) {
+        AsyncResponseStream *response = request->beginResponseStream("application/json");
+        response->print("{\"rhythms\":[");
+        for (size_t i = 0; i < wavePack.count(); i++)
+        {
+            response->printf("%s\"%s\"", i ? "," : "", wavePack.name(i));
+        }
+        response->print("]}");
+        request->send(response);
+    });
+
+    server.on("/api/control", HTTP_POST, [](AsyncWebServerRequest *request) {
+        JsonDocument doc;
+        if (!parseBody(request, doc))
+        {
+            return;
+        }
+        ControlSet control;
+        const char *error = parseControl(doc.as<JsonObjectConst>(), control);
+        if (error != nullptr)
+        {
+            request->send(400, "text/plain", error);
+            return;
+        }
+        idleResume(); // Changes are taken up by the generator, which is stopped while idle
+        remoteControl.apply(control);
+        sendState(request);
+    }, nullptr, collectBody);
+
+    server.on("/api/scenario", HTTP_POST, [](AsyncWebServerRequest *request) {
+        JsonDocument doc;
+        if (!parseBody(request, doc))
+        {
+            return;
+        }
+        size_t count = 0;
+        uint32_t loopAt = 0;
+        const char *error = compileScenario(doc, count, loopAt);
+        if (error != nullptr)
+        {
+            request->send(400, "text/plain", error);
+            return;
+        }
+        idleResume(); // Only a running generator takes over the previous scenario and frees the handover
+        if (!remoteControl.loadScenario(compiledSteps, count, loopAt))
+        {
+            request->send(409, "text/plain", "The previous scenario has not started yet, try again");
+            return;
+        }
+        request->send(200, "application/json", "{\"steps\":" + String(count) + "}");
+    }, nullptr, collectBody);
+
+    server.on("/api/scenario", HTTP_DELETE, [](AsyncWebServerRequest *request) {
+        idleResume();
+        if (!remoteControl.stopScenario())
+        {
+            request->send(409, "text/plain", "The previous scenario has not started yet, try again");
+            return;
+        }
+        sendState(request);
+    });
+}
+
+/**
+ * @brief Applies a StreamControl sent by a /ws client.
+ *
+ * @param data The message.
+ * @param len Message length; anything but a StreamControl is ignored.
+ */
+void handleControlMessage(const uint8_t *data, size_t len)
+{
+    StreamControl message;
+    if (len != sizeof(message))
+    {
+        return;
+    }
+    memcpy(&message, data, sizeof(message));
+    ControlSet control = { message.set, message.state, message.bpm, message.amp, message.rhythm };
+    remoteControl.apply(control);
+}
@@ -0,0 +1,29 @@
+/**
+ * @file ControlApi.h
+ * @brief REST and WebSocket control of the generator, for running a session away from the box.
+ *
+ *     GET    /api/control   Parameters in use, the overrides and the scenario position.
+ *     POST   /api/control   {"bpm":90,"amp":120,"mode":"ary","alive":true,"rhythm":"vt"}; any subset, 0 hands bpm or
+ *                           amp back to its knob, a "mode" or "rhythm":"" goes back to the built-in EKG or ARY.
+ *     GET    /api/rhythms   Names of the rhythms in the waveform pack.
+ *     POST   /api/scenario  {"loopMs":60000,"steps":[{"at":0,"bpm":70},{"at":20000,"mode":"ary"},...]}
+ *     DELETE /api/scenario  Stops the scenario; what it last set stays in effect.
+ *
+ * Scenario steps take the same fields as POST /api/control plus "at", milliseconds from the start,
+ * in ascending order. They are checked and compiled into ScenarioSteps on upload, so the producer
+ * never parses anything while playing. /ws clients can send a StreamControl instead of a POST.
+ */
+
+#ifndef ControlApi_h
+#define ControlApi_h
+
+#include <ESPAsyncWebServer.h>
+
+#ifndef CONTROL_BODY_MAX
+#define CONTROL_BODY_MAX 8192 ///< Largest request body accepted, enough for SCENARIO_MAX_STEPS steps.
+#endif
+
+void addControlRoutes(AsyncWebServer &server); ///< Adds the /api/control and /api/scenario handlers.
+void handleControlMessage(const uint8_t *data, size_t len); ///< Applies a StreamControl received on /ws.
+
+#endif
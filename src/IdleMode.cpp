@@ -0,0 +1,116 @@
+/**
+ * @file IdleMode.cpp
+ * @brief Implementation of the demand-driven idle mode.
+ */
+
+#include "IdleMode.h"
+#include "Metrics.h"
+#include <freertos/semphr.h>
+#include <atomic>
+
+static IdleHook idleHook = nullptr; ///< Starts and stops the generator.
+static TaskHandle_t loopTaskHandle = nullptr; ///< Task woken by idleResume().
+static SemaphoreHandle_t idleLock = nullptr; ///< Serializes going idle and resuming.
+static std::atomic<bool> idle(false); ///< Written under idleLock.
+static std::atomic<bool> demanded(false); ///< Set by every join, so loop() notices it even before the subscriber counts.
+static std::atomic<uint32_t> idleEntries(0); ///< Times the device went idle since boot.
+static unsigned long lastDemand = 0; ///< When there last was a subscriber; loop() only.
+
+/**
+ * @brief Records the loop task and the hook; the device starts out streaming.
+ *
+ * @param hook Called with false to stop the generator and with true to restart it.
+ */
+void idleBegin(IdleHook hook)
+{
+    idleHook = hook;
+    loopTaskHandle = xTaskGetCurrentTaskHandle();
+    idleLock = xSemaphoreCreateMutex();
+    lastDemand = millis();
+}
+
+/**
+ * @brief Goes idle once there have been no subscribers for IDLE_GRACE_MS.
+ *
+ * @param subscribers Stream clients connected right now.
+ */
+void idleService(size_t subscribers)
+{
+    const unsigned long now = millis();
+    if (demanded.exchange(false) || subscribers > 0)
+    {
+        lastDemand = now;
+        return;
+    }
+#if IDLE_POWER_SAVE
+    if (idle.load(std::memory_order_relaxed) || idleLock == nullptr || now - lastDemand < IDLE_GRACE_MS)
+    {
+        return;
+    }
+    xSemaphoreTake(idleLock, portMAX_DELAY);
+    if (!demanded.load()) // A join since the count was taken keeps the stream up
+    {
+        idle.store(true, std::memory_order_relaxed);
+        idleHook(false);
+        WiFi.setSleep(IDLE_WIFI_PS);
+        idleEntries.store(idleEntries.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+        Serial.println("No viewers, generator stopped");
+    }
+    xSemaphoreGive(idleLock);
+#endif
+}
+
+/**
+ * @brief Restarts the generator if it is stopped, and wakes loop() to note the new subscriber.
+ *
+ * The generator restarts on the calling task, so a joining client does not wait for loop().
+ */
+void idleResume()
+{
+    demanded.store(true);
+    if (idleLock == nullptr)
+    {
+        return;
+    }
+    xSemaphoreTake(idleLock, portMAX_DELAY);
+    if (idle.load(std::memory_order_relaxed))
+    {
+        idle.store(false, std::memory_order_relaxed); // Before the hook, so the stream task it wakes stays awake
+        idleHook(true);
+        WiFi.setSleep(ACTIVE_WIFI_PS);
+    }
+    xSemaphoreGive(idleLock);
+    xTaskNotifyGive(loopTaskHandle);
+}
+
+/**
+ * @brief Blocks loop() until idleResume() wakes it or the wait for the current mode has passed.
+ *
+ * @param portal Whether the setup portal is up; its DNS server keeps loop() at the active pace.
+ */
+void idleLoopWait(bool portal)
+{
+    const uint32_t waitMs = idle.load(std::memory_order_relaxed) && !portal ? LOOP_IDLE_WAIT_MS : LOOP_ACTIVE_WAIT_MS;
+    ulTaskNotifyTake(pdTRUE, pdMS_TO_TICKS(waitMs));
+}
+
+/**
+ * @brief Whether the generator is stopped.
+ */
+bool idleActive()
+{
+    return idle.load(std::memory_order_relaxed);
+}
+
+/**
+ * @brief Prints the idle state and how often it was entered.
+ *
+ * @param out Destination, typically an AsyncResponseStream.
+ */
+void writeIdleMetrics(Print &out)
+{
+    out.printf("# HELP " METRICS_PREFIX "idle 1 while the generator is stopped for lack of viewers.\n# TYPE " METRICS_PREFIX "idle gauge\n"
+               METRICS_PREFIX "idle %u\n", idle.load(std::memory_order_relaxed) ? 1u : 0u);
+    out.printf("# HELP " METRICS_PREFIX "idle_entries_total Times the generator was stopped for lack of viewers.\n# TYPE " METRICS_PREFIX "idle_entries_total counter\n"
+               METRICS_PREFIX "idle_entries_total %u\n", idleEntries.load(std::memory_order_relaxed));
+}
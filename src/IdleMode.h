@@ -0,0 +1,50 @@
+/**
+ * @file IdleMode.h
+ * @brief Demand-driven power saving: the generator and the radio only run at full rate while someone is watching.
+ *
+ * loop() reports the number of stream subscribers on every pass through idleService(). Once there
+ * have been none for IDLE_GRACE_MS, the hook given to idleBegin() is called with false. main.cpp then
+ * stops the sample timer, so the producer and stream tasks block until it restarts, pauses the input
+ * task that reads the knobs, and the radio drops to IDLE_WIFI_PS. loop() blocks between passes in
+ * idleLoopWait(), for up to LOOP_IDLE_WAIT_MS while idle. A joining subscriber calls idleResume()
+ * from the async_tcp task, which calls the hook with true right there, so the next frame is generated
+ * one sample period later. Control requests call it too, since only the running generator takes up a
+ * change or a scenario. Transitions are made under a mutex, and a join that races the switch to idle
+ * always wins.
+ */
+
+#ifndef IdleMode_h
+#define IdleMode_h
+
+#include <Arduino.h>
+#include <WiFi.h>
+
+#ifndef IDLE_POWER_SAVE
+#define IDLE_POWER_SAVE 1 ///< 0 keeps streaming with nobody watching; loop() still blocks between passes.
+#endif
+#ifndef IDLE_GRACE_MS
+#define IDLE_GRACE_MS 5000 ///< Time without subscribers before going idle, longer than a page reload.
+#endif
+#ifndef LOOP_ACTIVE_WAIT_MS
+#define LOOP_ACTIVE_WAIT_MS 10 ///< Longest loop() blocks between passes while streaming or while the portal is up.
+#endif
+#ifndef LOOP_IDLE_WAIT_MS
+#define LOOP_IDLE_WAIT_MS 1000 ///< Longest loop() blocks between passes while idle.
+#endif
+#ifndef IDLE_WIFI_PS
+#define IDLE_WIFI_PS WIFI_PS_MAX_MODEM ///< Station power save while idle: wake only for every listen interval's beacon.
+#endif
+#ifndef ACTIVE_WIFI_PS
+#define ACTIVE_WIFI_PS WIFI_PS_MIN_MODEM ///< Station power save while streaming, the framework's default.
+#endif
+
+typedef void (*IdleHook)(bool streaming); ///< Starts (true) or stops (false) the generator.
+
+void idleBegin(IdleHook hook); ///< Records the loop task and the hook; call from setup(), which runs on the loop task.
+void idleService(size_t subscribers); ///< Goes idle after IDLE_GRACE_MS without subscribers; loop() only.
+void idleResume(); ///< Resumes full rate at once and wakes loop(); call when a subscriber joins or a control request arrives, from any task.
+void idleLoopWait(bool portal); ///< Blocks loop() until woken or until the wait for the current mode has passed.
+bool idleActive(); ///< Whether the generator is stopped.
+void writeIdleMetrics(Print &out); ///< Prints the idle state and transitions in Prometheus text format.
+
+#endif
@@ -0,0 +1,144 @@
+/**
+ * @file InputSampler.cpp
+ * @brief Implementation of the potentiometer filter and the input task.
+ */
+
+#include "InputSampler.h"
+#include "MemoryReport.h"
+#include "Metrics.h"
+#include <esp_timer.h>
+
+static AnalogKnob *inputKnobs[INPUT_MAX_KNOBS]; ///< Knobs serviced by the input task.
+static size_t inputKnobCount = 0; ///< Number of valid entries in inputKnobs.
+static TaskHandle_t inputTaskHandle = nullptr; ///< Input task, woken by setInputSampling(true).
+static std::atomic<bool> inputRunning(true); ///< Whether the input task samples or blocks.
+
+/**
+ * @brief Constructs a knob that maps the full ADC travel onto [outMin, outMax].
+ *
+ * @param pin ADC pin the knob is wired to.
+ * @param outMin Value at the bottom of the travel.
+ * @param outMax Value at the top of the travel.
+ */
+AnalogKnob::AnalogKnob(uint8_t pin, int32_t outMin, int32_t outMax)
+    : _pin(pin), _outMin(outMin), _outMax(outMax), _filtered(0), _anchor(0), _value(outMin)
+{
+}
+
+/**
+ * @brief Seeds the filter with a single reading and publishes its value.
+ */
+void AnalogKnob::prime()
+{
+    const int32_t raw = analogRead(_pin);
+    _filtered = raw << INPUT_IIR_SHIFT;
+    _anchor = raw;
+    _value.store(map(raw, 0, ADC_MAX, _outMin, _outMax), std::memory_order_relaxed);
+}
+
+/**
+ * @brief Feeds one reading through the IIR filter and the hysteresis band.
+ *
+ * The filter is y += (x - y) / 2^INPUT_IIR_SHIFT, kept scaled by 2^INPUT_IIR_SHIFT so no precision is
+ * lost. The output is only re-mapped once the filtered reading is INPUT_HYSTERESIS counts away from
+ * the reading it was last mapped from, so ADC noise cannot make it flicker between two values. The
+ * ends of the travel always map exactly to outMin and outMax.
+ */
+void AnalogKnob::sample()
+{
+    const int32_t raw = analogRead(_pin);
+    _filtered += raw - (_filtered >> INPUT_IIR_SHIFT);
+    const int32_t smoothed = _filtered >> INPUT_IIR_SHIFT;
+
+    int32_t target = smoothed;
+    if (smoothed <= INPUT_HYSTERESIS)
+    {
+        target = 0;
+    }
+    else if (smoothed >= ADC_MAX - INPUT_HYSTERESIS)
+    {
+        target = ADC_MAX;
+    }
+    const bool atEnd = target == 0 || target == ADC_MAX;
+    if (target == _anchor || (!atEnd && abs(target - _anchor) < INPUT_HYSTERESIS))
+    {
+        return;
+    }
+    _anchor = target;
+    _value.store(map(_anchor, 0, ADC_MAX, _outMin, _outMax), std::memory_order_relaxed);
+}
+
+/**
+ * @brief Input task body. Samples every knob at INPUT_SAMPLE_RATE, or blocks while sampling is paused.
+ *
+ * A resume re-primes the knobs, so a knob turned while paused jumps to where it is now instead of
+ * gliding there through the filter.
+ *
+ * @param arg Unused.
+ */
+static void inputTask(void *arg)
+{
+    TickType_t lastWake = xTaskGetTickCount();
+    const TickType_t period = pdMS_TO_TICKS(1000 / INPUT_SAMPLE_RATE) ? pdMS_TO_TICKS(1000 / INPUT_SAMPLE_RATE) : 1;
+    for (;;)
+    {
+        if (!inputRunning.load(std::memory_order_relaxed))
+        {
+            ulTaskNotifyTake(pdTRUE, portMAX_DELAY); // A stale notification only costs one more check
+            if (inputRunning.load(std::memory_order_relaxed))
+            {
+                for (size_t i = 0; i < inputKnobCount; i++)
+                {
+                    inputKnobs[i]->prime();
+                }
+                lastWake = xTaskGetTickCount();
+            }
+            continue;
+        }
+        vTaskDelayUntil(&lastWake, period);
+        const int64_t start = esp_timer_get_time();
+        for (size_t i = 0; i < inputKnobCount; i++)
+        {
+            inputKnobs[i]->sample();
+        }
+        metricsStageTime(STAGE_ACQUIRE, esp_timer_get_time() - start);
+    }
+}
+
+/**
+ * @brief Primes the given knobs and starts the task that keeps them up to date.
+ *
+ * @param knobs Knobs to sample; only the first INPUT_MAX_KNOBS are used.
+ * @param count Number of entries in @p knobs.
+ * @return true if the input task was created.
+ */
+bool startInputSampling(AnalogKnob *const *knobs, size_t count)
+{
+    for (size_t i = 0; i < count && inputKnobCount < INPUT_MAX_KNOBS; i++)
+    {
+        knobs[i]->prime();
+        inputKnobs[inputKnobCount++] = knobs[i];
+    }
+
+    if (xTaskCreatePinnedToCore(inputTask, "input", INPUT_TASK_STACK, nullptr, INPUT_TASK_PRIORITY, &inputTaskHandle, ARDUINO_RUNNING_CORE) != pdPASS)
+    {
+        Serial.println("Failed to create input task");
+        return false;
+    }
+    memoryTrackTask("input", INPUT_TASK_STACK);
+    return true;
+}
+
+/**
+ * @brief Pauses or resumes the input task, so it does not wake for the ADC while nothing uses the knobs.
+ *
+ * @param running true to sample at INPUT_SAMPLE_RATE again, false to block until the next resume.
+ */
+void setInputSampling(bool running)
+{
+    inputRunning.store(running, std::memory_order_relaxed);
+    if (running && inputTaskHandle)
+    {
+        xTaskNotifyGive(inputTaskHandle);
+    }
+}
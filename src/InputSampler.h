@@ -0,0 +1,60 @@
+/**
+ * @file InputSampler.h
+ * @brief Slow, smoothed sampling of the front panel potentiometers.
+ *
+ * The knobs only move a few times a second, so they are read by a low-priority task at
+ * INPUT_SAMPLE_RATE instead of on every pass of loop(). Each reading goes through an IIR low-pass
+ * and a hysteresis band before it is mapped to its output range. The result is published as an
+ * atomic that any task can read without touching the ADC. While the generator is idle the task is
+ * paused with setInputSampling(), and the values hold where they were.
+ */
+
+#ifndef InputSampler_h
+#define InputSampler_h
+
+#include <Arduino.h>
+#include <atomic>
+
+#ifndef INPUT_SAMPLE_RATE
+#define INPUT_SAMPLE_RATE 50 ///< Knob readings per second.
+#endif
+#ifndef INPUT_IIR_SHIFT
+#define INPUT_IIR_SHIFT 3 ///< IIR smoothing factor as a shift, each reading moves the filter 1/2^shift of the way.
+#endif
+#ifndef INPUT_HYSTERESIS
+#define INPUT_HYSTERESIS 24 ///< ADC counts the filtered reading must move before the output changes.
+#endif
+#ifndef INPUT_MAX_KNOBS
+#define INPUT_MAX_KNOBS 4 ///< Number of knobs the input task can service.
+#endif
+
+#define INPUT_TASK_PRIORITY 1 ///< Below loopTask; the knobs are never urgent.
+#define INPUT_TASK_STACK 2048 ///< Stack size in bytes for the input task.
+#define ADC_MAX 4095 ///< Full-scale reading of the 12-bit ADC.
+
+/**
+ * @class AnalogKnob
+ * @brief One potentiometer, filtered and mapped onto an integer range.
+ */
+class AnalogKnob
+{
+public:
+    AnalogKnob(uint8_t pin, int32_t outMin, int32_t outMax);
+
+    void prime(); ///< Takes one reading and starts the filter there, so value() is valid straight away.
+    void sample(); ///< Takes one reading and updates value() if it left the hysteresis band.
+    int32_t value() const { return _value.load(std::memory_order_relaxed); } ///< Latest published value.
+
+private:
+    uint8_t _pin; ///< ADC pin the knob is wired to.
+    int32_t _outMin; ///< Published value at the bottom of the travel.
+    int32_t _outMax; ///< Published value at the top of the travel.
+    int32_t _filtered; ///< IIR state in ADC counts scaled by 2^INPUT_IIR_SHIFT.
+    int32_t _anchor; ///< Filtered reading the current value was mapped from.
+    std::atomic<int32_t> _value; ///< Published output.
+};
+
+bool startInputSampling(AnalogKnob *const *knobs, size_t count); ///< Primes @p knobs and starts the task that samples them.
+void setInputSampling(bool running); ///< Resumes (true) or pauses (false) the input task; from any task.
+
+#endif
@@ -0,0 +1,85 @@
+/**
+ * @file LatencyTrace.cpp
+ * @brief Aggregation of the end-to-end latency stages.
+ */
+
+#include "LatencyTrace.h"
+#include "Metrics.h"
+#include <esp_timer.h>
+
+static const uint32_t stageBounds[] = { 1000, 2000, 5000, 10000, 20000, 50000, 100000, 200000, 500000, 1000000, 2000000, 5000000 };
+static const size_t stageBoundCount = sizeof(stageBounds) / sizeof(stageBounds[0]);
+
+static LatencyHistogram fifoLatency(stageBounds, stageBoundCount); ///< Written from the stream task.
+static LatencyHistogram networkLatency(stageBounds, stageBoundCount); ///< Written from the async_tcp task.
+static LatencyHistogram renderLatency(stageBounds, stageBoundCount); ///< Written from the async_tcp task.
+static LatencyHistogram totalLatency(stageBounds, stageBoundCount); ///< Written from the async_tcp task.
+
+/**
+ * @brief Records how long a batch waited on the device before it was handed to the socket.
+ *
+ * @param genUs Generation time of the oldest frame in the batch.
+ * @param sentUs Time the batch was handed off.
+ */
+void traceBatchSent(uint32_t genUs, uint32_t sentUs)
+{
+    fifoLatency.record(sentUs - genUs);
+}
+
+/**
+ * @brief Records one echo.
+ *
+ * The round trip is measured from sentUs to now, minus what the browser spent before it echoed.
+ * Half of it is taken as the one-way network delay.
+ *
+ * @param data Message received from the client.
+ * @param len Message length; anything but a LatencyEcho is ignored.
+ */
+void traceEcho(const uint8_t *data, size_t len)
+{
+    LatencyEcho echo;
+    if (len != sizeof(echo) || data[0] != LATENCY_ECHO_TYPE)
+    {
+        return;
+    }
+    memcpy(&echo, data, sizeof(echo));
+
+    const uint32_t now = (uint32_t)esp_timer_get_time();
+    const uint32_t roundTrip = now - echo.sentUs;
+    const uint32_t network = roundTrip > echo.clientUs ? (roundTrip - echo.clientUs) / 2 : 0;
+    networkLatency.record(network);
+    renderLatency.record(echo.clientUs);
+    totalLatency.record((echo.sentUs - echo.genUs) + network + echo.clientUs);
+}
+
+/**
+ * @brief Prints one stage's p50/p90/p99 as gauges.
+ */
+static void writeQuantiles(Print &out, const char *stage, const LatencyHistogram &histogram)
+{
+    static const uint8_t percents[] = { 50, 90, 99 };
+    for (uint8_t percent : percents)
+    {
+        out.printf(METRICS_PREFIX "e2e_latency_quantile_us{stage=\"%s\",quantile=\"0.%02u\"} %u\n", stage, percent, histogram.quantile(percent));
+    }
+}
+
+/**
+ * @brief Prints the stage histograms, then their percentiles estimated from the buckets.
+ *
+ * @param out Destination, typically an AsyncResponseStream.
+ */
+void writeLatencyMetrics(Print &out)
+{
+    fifoLatency.write(out, "e2e_fifo_us", "Sample generation to socket hand-off, in microseconds.");
+    networkLatency.write(out, "e2e_network_us", "One-way network delay to the browser, half the echo round trip, in microseconds.");
+    renderLatency.write(out, "e2e_render_us", "Browser receive to the sweep drawing the frame, playback delay included, in microseconds.");
+    totalLatency.write(out, "e2e_total_us", "Sample generation to browser render, in microseconds.");
+
+    out.print("# HELP " METRICS_PREFIX "e2e_latency_quantile_us Latency percentiles per stage, bucket upper bounds.\n"
+              "# TYPE " METRICS_PREFIX "e2e_latency_quantile_us gauge\n");
+    writeQuantiles(out, "fifo", fifoLatency);
+    writeQuantiles(out, "network", networkLatency);
+    writeQuantiles(out, "render", renderLatency);
+    writeQuantiles(out, "total", totalLatency);
+}
@@ -0,0 +1,39 @@
+/**
+ * @file LatencyTrace.h
+ * @brief End-to-end latency tracing from sample generation to the browser's render.
+ *
+ * The producer stamps every frame with esp_timer_get_time(). The /ws frame header carries that
+ * stamp and the time the frame was handed to the socket. About once a second the page echoes
+ * both back as a LatencyEcho, along with how long it took from receiving the frame to the page's
+ * sweep drawing it. From that the device splits the delay into:
+ * - fifo: generation to hand-off, measured on the device
+ * - network: half the round trip, with the browser's time taken out
+ * - render: receive to drawn, measured by the browser; includes the page's playback delay
+ * - total: the sum of the three
+ * Only the device's own clock is compared with itself, so the two clocks never need to agree.
+ */
+
+#ifndef LatencyTrace_h
+#define LatencyTrace_h
+
+#include <Arduino.h>
+
+#define LATENCY_ECHO_TYPE 1 ///< LatencyEcho::type, tells echoes apart from future client messages.
+
+/**
+ * @brief Message the page sends back over /ws. All fields are little-endian.
+ */
+struct __attribute__((packed)) LatencyEcho
+{
+    uint8_t type;        ///< LATENCY_ECHO_TYPE.
+    uint8_t reserved[3]; ///< Always 0.
+    uint32_t sentUs;     ///< StreamFrameHeader::sentUs of the echoed frame.
+    uint32_t genUs;      ///< StreamFrameHeader::genUs of the echoed frame.
+    uint32_t clientUs;   ///< Time from receiving the frame to rendering it, on the browser's clock.
+};
+
+void traceBatchSent(uint32_t genUs, uint32_t sentUs); ///< Records how long a batch waited on the device.
+void traceEcho(const uint8_t *data, size_t len); ///< Records a LatencyEcho received from a client.
+void writeLatencyMetrics(Print &out); ///< Prints the stage histograms and percentiles in Prometheus text format.
+
+#endif
@@ -0,0 +1,201 @@
+/**
+ * @file MemoryReport.cpp
+ * @brief Implementation of the runtime memory report.
+ */
+
+#include "MemoryReport.h"
+#include "Metrics.h"
+#include <AsyncTCP.h>
+#include <esp_heap_caps.h>
+#include <atomic>
+
+/**
+ * @brief A task in the report.
+ */
+struct TrackedTask
+{
+    const char *name;    ///< FreeRTOS task name.
+    uint32_t stackBytes; ///< Stack it was created with, 0 if unknown.
+};
+
+/**
+ * @brief Heap taken by one boot stage.
+ */
+struct HeapStage
+{
+    const char *name; ///< Subsystem brought up in the stage.
+    int32_t bytes;    ///< Heap taken, negative if the stage freed more than it kept.
+};
+
+/// Tasks started by the framework and the libraries, with the stack sizes they are configured with.
+static const TrackedTask systemTasks[] = {
+    { "loopTask", (uint32_t)getArduinoLoopTaskStackSize() },
+    { "async_tcp", CONFIG_ASYNC_TCP_STACK_SIZE },
+#ifdef CONFIG_ESP_TIMER_TASK_STACK_SIZE
+    { "esp_timer", CONFIG_ESP_TIMER_TASK_STACK_SIZE },
+#endif
+#ifdef CONFIG_FREERTOS_TIMER_TASK_STACK_DEPTH
+    { "Tmr Svc", CONFIG_FREERTOS_TIMER_TASK_STACK_DEPTH },
+#endif
+#ifdef CONFIG_LWIP_TCPIP_TASK_STACK_SIZE
+    { "tiT", CONFIG_LWIP_TCPIP_TASK_STACK_SIZE },
+#endif
+};
+static const size_t systemTaskCount = sizeof(systemTasks) / sizeof(systemTasks[0]);
+
+static TrackedTask tasks[MEMORY_MAX_TASKS - systemTaskCount]; ///< Tasks registered with memoryTrackTask().
+static std::atomic<uint8_t> taskCount(0); ///< Entries of tasks that are filled in.
+static HeapStage stages[MEMORY_MAX_STAGES]; ///< Boot stages in the order they were marked.
+static std::atomic<uint8_t> stageCount(0); ///< Entries of stages that are filled in.
+static uint32_t freeAtLastMark = 0; ///< Free heap at the previous mark; setup() only.
+
+/**
+ * @brief Charges the heap taken since the previous mark to a subsystem.
+ *
+ * The first mark is charged with everything in use when it is made, which is what the framework took
+ * before setup().
+ *
+ * @param subsystem Name of what was brought up; must outlive the report, a literal in practice.
+ */
+void memoryMarkStage(const char *subsystem)
+{
+    const uint32_t free = ESP.getFreeHeap();
+    const uint8_t count = stageCount.load(std::memory_order_relaxed);
+    const uint32_t before = count == 0 ? ESP.getHeapSize() : freeAtLastMark;
+    freeAtLastMark = free;
+    if (count >= MEMORY_MAX_STAGES)
+    {
+        return;
+    }
+    stages[count].name = subsystem;
+    stages[count].bytes = (int32_t)(before - free);
+    stageCount.store(count + 1, std::memory_order_release);
+}
+
+/**
+ * @brief Adds a task to the report.
+ *
+ * @param name FreeRTOS name the task is created with; must outlive the report, a literal in practice.
+ * @param stackBytes Stack size it is created with.
+ */
+void memoryTrackTask(const char *name, uint32_t stackBytes)
+{
+    const uint8_t count = taskCount.load(std::memory_order_relaxed);
+    if (count >= sizeof(tasks) / sizeof(tasks[0]))
+    {
+        return;
+    }
+    tasks[count].name = name;
+    tasks[count].stackBytes = stackBytes;
+    taskCount.store(count + 1, std::memory_order_release);
+}
+
+/**
+ * @brief Calls @p visit for every tracked task, the system ones first.
+ */
+template <typename Visit>
+static void forEachTask(Visit visit)
+{
+    for (size_t i = 0; i < systemTaskCount; i++)
+    {
+        visit(systemTasks[i]);
+    }
+    const uint8_t count = taskCount.load(std::memory_order_acquire);
+    for (uint8_t i = 0; i < count; i++)
+    {
+        visit(tasks[i]);
+    }
+}
+
+/**
+ * @brief Least stack a task has had free since it started.
+ *
+ * @param task The task.
+ * @param[out] minFree The high-water mark in bytes.
+ * @return false if no task of that name is running.
+ */
+static bool stackHighWater(const TrackedTask &task, uint32_t &minFree)
+{
+    TaskHandle_t handle = xTaskGetHandle(task.name);
+    if (handle == nullptr)
+    {
+        return false;
+    }
+    minFree = uxTaskGetStackHighWaterMark(handle); // Bytes on the ESP32, where a stack word is one byte
+    return true;
+}
+
+/**
+ * @brief Prints the least free stack of every running tracked task.
+ *
+ * @param out Destination, typically an AsyncResponseStream.
+ */
+void writeMemoryMetrics(Print &out)
+{
+    out.print("# HELP " METRICS_PREFIX "task_stack_min_free_bytes Least stack a task has had free since it started.\n"
+              "# TYPE " METRICS_PREFIX "task_stack_min_free_bytes gauge\n");
+    forEachTask([&out](const TrackedTask &task) {
+        uint32_t minFree;
+        if (stackHighWater(task, minFree))
+        {
+            out.printf(METRICS_PREFIX "task_stack_min_free_bytes{task=\"%s\"} %u\n", task.name, minFree);
+        }
+    });
+}
+
+/**
+ * @brief Answers GET /api/memory.
+ *
+ * "heap" is the whole heap and its internal and DMA-capable parts, "subsystems" the heap taken by each
+ * boot stage plus "runtime" for everything in use beyond them, and "tasks" the configured stack and
+ * least free stack of each tracked task, null for one that is not running.
+ */
+static void sendMemoryReport(AsyncWebServerRequest *request)
+{
+    AsyncResponseStream *response = request->beginResponseStream("application/json");
+    const uint32_t size = ESP.getHeapSize();
+    const uint32_t free = ESP.getFreeHeap();
+    response->printf("{\"heap\":{\"size\":%u,\"free\":%u,\"minFree\":%u,\"largestFreeBlock\":%u,"
+                     "\"internalFree\":%u,\"internalLargestFreeBlock\":%u,\"dmaFree\":%u,\"dmaLargestFreeBlock\":%u},",
+                     size, free, ESP.getMinFreeHeap(), ESP.getMaxAllocHeap(),
+                     (unsigned)heap_caps_get_free_size(MALLOC_CAP_INTERNAL), (unsigned)heap_caps_get_largest_free_block(MALLOC_CAP_INTERNAL),
+                     (unsigned)heap_caps_get_free_size(MALLOC_CAP_DMA), (unsigned)heap_caps_get_largest_free_block(MALLOC_CAP_DMA));
+
+    response->print("\"subsystems\":{");
+    int32_t booted = 0;
+    const uint8_t count = stageCount.load(std::memory_order_acquire);
+    for (uint8_t i = 0; i < count; i++)
+    {
+        response->printf("\"%s\":%d,", stages[i].name, stages[i].bytes);
+        booted += stages[i].bytes;
+    }
+    response->printf("\"runtime\":%d},", (int32_t)(size - free) - booted);
+
+    response->print("\"tasks\":[");
+    bool first = true;
+    forEachTask([&](const TrackedTask &task) {
+        uint32_t minFree;
+        response->printf("%s{\"name\":\"%s\",\"stack\":%u,\"minFree\":", first ? "" : ",", task.name, task.stackBytes);
+        if (stackHighWater(task, minFree))
+        {
+            response->printf("%u}", minFree);
+        }
+        else
+        {
+            response->print("null}");
+        }
+        first = false;
+    });
+    response->print("]}");
+    request->send(response);
+}
+
+/**
+ * @brief Adds the memory report handler.
+ *
+ * @param server The web server.
+ */
+void addMemoryRoutes(AsyncWebServer &server)
+{
+    server.on("/api/memory", HTTP_GET, sendMemoryReport);
+}
@@ -0,0 +1,32 @@
+/**
+ * @file MemoryReport.h
+ * @brief Runtime memory budget: heap taken by each subsystem at boot, task stack high-water marks and heap fragmentation.
+ *
+ * setup() calls memoryMarkStage() after bringing up each subsystem, which charges the heap taken since
+ * the previous mark to it; whatever is in use beyond those stages is reported as "runtime" (clients,
+ * their queues, lwIP buffers). Tasks are registered by name with the stack they were created with and
+ * looked up when the report is made, so tasks that only start later, like async_tcp on the first
+ * connection, are covered too. GET /api/memory returns it all as JSON; /metrics carries the stack
+ * high-water marks. The static side, RAM, IRAM and flash by module, is reported at build time by
+ * pio run -t footprint (scripts/footprint.py).
+ */
+
+#ifndef MemoryReport_h
+#define MemoryReport_h
+
+#include <Arduino.h>
+#include <ESPAsyncWebServer.h>
+
+#ifndef MEMORY_MAX_STAGES
+#define MEMORY_MAX_STAGES 16 ///< Boot stages recorded; later marks are ignored.
+#endif
+#ifndef MEMORY_MAX_TASKS
+#define MEMORY_MAX_TASKS 16 ///< Tasks tracked, the system tasks included.
+#endif
+
+void memoryMarkStage(const char *subsystem); ///< Charges the heap taken since the previous mark to @p subsystem; setup() only.
+void memoryTrackTask(const char *name, uint32_t stackBytes); ///< Adds a task to the report; @p name must outlive it.
+void writeMemoryMetrics(Print &out); ///< Prints the task stack high-water marks in Prometheus text format.
+void addMemoryRoutes(AsyncWebServer &server); ///< Adds GET /api/memory.
+
+#endif
@@ -0,0 +1,251 @@
+/**
+ * @file Metrics.cpp
+ * @brief Implementation of the performance counters and their Prometheus text output.
+ */
+
+#include "Metrics.h"
+#include <AsyncTCP.h>
+#include <esp_timer.h>
+
+static const uint32_t notifyBounds[] = { 50, 100, 200, 500, 1000, 2000, 5000, 10000 };
+
+static LatencyHistogram notifyLatency(notifyBounds, sizeof(notifyBounds) / sizeof(notifyBounds[0]));
+
+static std::atomic<uint32_t> timerTicks(0); ///< Sample timer callbacks since boot.
+static std::atomic<uint32_t> timerJitterSumUs(0); ///< Sum of |interval - period| over all callbacks.
+static std::atomic<uint32_t> timerJitterMaxUs(0); ///< Largest |interval - period| since the last scrape.
+static int64_t lastTimerUs = 0; ///< Time of the previous callback; timer task only.
+
+static std::atomic<uint32_t> loopIterations(0); ///< loop() passes since boot.
+static std::atomic<uint32_t> loopRate(0); ///< loop() passes during the last full second.
+static uint32_t loopIterationsAtSecond = 0; ///< loopIterations when the current second started; loop() only.
+static unsigned long loopSecondStart = 0; ///< millis() when the current second started; loop() only.
+
+static const char *const stageNames[STAGE_COUNT] = { "acquire", "generate", "encode" };
+static std::atomic<uint32_t> stageBusyMs[STAGE_COUNT]; ///< Busy time per stage, written by that stage's task.
+static uint32_t stageBusyRemainderUs[STAGE_COUNT]; ///< Microseconds not yet folded into stageBusyMs; owning task only.
+static std::atomic<int8_t> stageCore[STAGE_COUNT]; ///< Core each stage last ran on.
+
+static std::atomic<uint32_t> fifoDepth(0);
+static std::atomic<uint32_t> fifoHighWater(0);
+static std::atomic<uint32_t> fifoOverruns(0);
+
+/**
+ * @brief Constructs an empty histogram.
+ *
+ * @param bounds Ascending bucket upper bounds in microseconds; must outlive the histogram.
+ * @param boundCount Number of entries in @p bounds; anything above METRICS_HISTOGRAM_BUCKETS is ignored.
+ */
+LatencyHistogram::LatencyHistogram(const uint32_t *bounds, size_t boundCount)
+    : _bounds(bounds), _boundCount(boundCount < METRICS_HISTOGRAM_BUCKETS ? boundCount : METRICS_HISTOGRAM_BUCKETS), _sumUs(0)
+{
+    for (std::atomic<uint32_t> &bucket : _buckets)
+    {
+        bucket.store(0, std::memory_order_relaxed);
+    }
+}
+
+/**
+ * @brief Adds one observation to its bucket.
+ *
+ * @param us Observed latency in microseconds.
+ */
+void LatencyHistogram::record(uint32_t us)
+{
+    size_t i = 0;
+    while (i < _boundCount && us > _bounds[i])
+    {
+        i++;
+    }
+    _buckets[i].store(_buckets[i].load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+    _sumUs.store(_sumUs.load(std::memory_order_relaxed) + us, std::memory_order_relaxed);
+}
+
+/**
+ * @brief Number of observations recorded so far.
+ */
+uint32_t LatencyHistogram::count() const
+{
+    uint32_t total = 0;
+    for (size_t i = 0; i <= _boundCount; i++)
+    {
+        total += _buckets[i].load(std::memory_order_relaxed);
+    }
+    return total;
+}
+
+/**
+ * @brief Estimates a percentile as the upper bound of the bucket it falls into.
+ *
+ * @param percent Percentile, 1 to 100.
+ * @return The bucket bound in microseconds, the last bound if it lies in the +Inf bucket, or 0 without data.
+ */
+uint32_t LatencyHistogram::quantile(uint8_t percent) const
+{
+    const uint32_t total = count();
+    if (total == 0)
+    {
+        return 0;
+    }
+    const uint64_t rank = ((uint64_t)total * percent + 99) / 100;
+    uint32_t cumulative = 0;
+    for (size_t i = 0; i < _boundCount; i++)
+    {
+        cumulative += _buckets[i].load(std::memory_order_relaxed);
+        if (cumulative >= rank)
+        {
+            return _bounds[i];
+        }
+    }
+    return _boundCount ? _bounds[_boundCount - 1] : 0;
+}
+
+/**
+ * @brief Prints the histogram with cumulative "le" buckets, _sum and _count.
+ *
+ * @param out Destination.
+ * @param name Metric name without METRICS_PREFIX.
+ * @param help Description for the HELP line.
+ */
+void LatencyHistogram::write(Print &out, const char *name, const char *help) const
+{
+    out.printf("# HELP " METRICS_PREFIX "%s %s\n# TYPE " METRICS_PREFIX "%s histogram\n", name, help, name);
+    uint32_t cumulative = 0;
+    for (size_t i = 0; i < _boundCount; i++)
+    {
+        cumulative += _buckets[i].load(std::memory_order_relaxed);
+        out.printf(METRICS_PREFIX "%s_bucket{le=\"%u\"} %u\n", name, _bounds[i], cumulative);
+    }
+    cumulative += _buckets[_boundCount].load(std::memory_order_relaxed);
+    out.printf(METRICS_PREFIX "%s_bucket{le=\"+Inf\"} %u\n", name, cumulative);
+    out.printf(METRICS_PREFIX "%s_sum %u\n" METRICS_PREFIX "%s_count %u\n", name, _sumUs.load(std::memory_order_relaxed), name, cumulative);
+}
+
+/**
+ * @brief Records one sample timer callback and how far its interval strayed from the period.
+ *
+ * @param periodUs The period the timer is programmed with.
+ */
+void metricsTimerTick(uint32_t periodUs)
+{
+    const int64_t now = esp_timer_get_time();
+    if (lastTimerUs != 0)
+    {
+        const int64_t interval = now - lastTimerUs;
+        const uint32_t jitter = interval > periodUs ? interval - periodUs : periodUs - interval;
+        timerJitterSumUs.store(timerJitterSumUs.load(std::memory_order_relaxed) + jitter, std::memory_order_relaxed);
+        if (jitter > timerJitterMaxUs.load(std::memory_order_relaxed))
+        {
+            timerJitterMaxUs.store(jitter, std::memory_order_relaxed);
+        }
+    }
+    lastTimerUs = now;
+    timerTicks.store(timerTicks.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+}
+
+/**
+ * @brief Forgets the previous timer callback; call while the timer is stopped, before starting it again.
+ */
+void metricsTimerRestart()
+{
+    lastTimerUs = 0;
+}
+
+/**
+ * @brief Records one loop() pass and refreshes the per-second rate once a second.
+ */
+void metricsLoopTick()
+{
+    const uint32_t iterations = loopIterations.load(std::memory_order_relaxed) + 1;
+    loopIterations.store(iterations, std::memory_order_relaxed);
+    const unsigned long now = millis();
+    if (now - loopSecondStart >= 1000)
+    {
+        loopRate.store(iterations - loopIterationsAtSecond, std::memory_order_relaxed);
+        loopIterationsAtSecond = iterations;
+        loopSecondStart = now;
+    }
+}
+
+/**
+ * @brief Records the time taken to hand one batch to the SSE and WebSocket transports.
+ *
+ * @param us Elapsed time in microseconds.
+ */
+void metricsNotifyLatency(uint32_t us)
+{
+    notifyLatency.record(us);
+}
+
+/**
+ * @brief Publishes the state of the sample FIFO.
+ *
+ * @param depth Frames queued right now.
+ * @param highWater Most frames ever queued at once.
+ * @param overruns Frames dropped because the FIFO was full.
+ */
+void metricsSetFifo(uint32_t depth, uint32_t highWater, uint32_t overruns)
+{
+    fifoDepth.store(depth, std::memory_order_relaxed);
+    fifoHighWater.store(highWater, std::memory_order_relaxed);
+    fifoOverruns.store(overruns, std::memory_order_relaxed);
+}
+
+/**
+ * @brief Adds the time a stage spent on one unit of work, and notes the core it ran on.
+ *
+ * Time is kept in whole milliseconds so the counter takes weeks rather than an hour to wrap.
+ *
+ * @param stage The stage; only that stage's task may call this.
+ * @param us Busy time in microseconds.
+ */
+void metricsStageTime(PipelineStage stage, uint32_t us)
+{
+    uint32_t remainder = stageBusyRemainderUs[stage] + us;
+    if (remainder >= 1000)
+    {
+        stageBusyMs[stage].store(stageBusyMs[stage].load(std::memory_order_relaxed) + remainder / 1000, std::memory_order_relaxed);
+        remainder %= 1000;
+    }
+    stageBusyRemainderUs[stage] = remainder;
+    stageCore[stage].store(xPortGetCoreID(), std::memory_order_relaxed);
+}
+
+/**
+ * @brief Prints one metric with its HELP and TYPE lines.
+ */
+static void writeMetric(Print &out, const char *name, const char *type, const char *help, uint32_t value)
+{
+    out.printf("# HELP " METRICS_PREFIX "%s %s\n# TYPE " METRICS_PREFIX "%s %s\n" METRICS_PREFIX "%s %u\n", name, help, name, type, name, value);
+}
+
+/**
+ * @brief Prints every device-wide metric.
+ *
+ * The jitter maximum restarts after each scrape, so it covers the time since the previous one.
+ *
+ * @param out Destination, typically an AsyncResponseStream.
+ */
+void writeMetrics(Print &out)
+{
+    writeMetric(out, "timer_ticks_total", "counter", "Sample timer callbacks since boot.", timerTicks.load(std::memory_order_relaxed));
+    writeMetric(out, "timer_jitter_us_sum", "counter", "Sum of the deviation of each timer interval from the period, in microseconds.", timerJitterSumUs.load(std::memory_order_relaxed));
+    writeMetric(out, "timer_jitter_us_max", "gauge", "Largest timer interval deviation since the last scrape, in microseconds.", timerJitterMaxUs.exchange(0, std::memory_order_relaxed));
+    writeMetric(out, "fifo_depth", "gauge", "Frames waiting in the sample FIFO.", fifoDepth.load(std::memory_order_relaxed));
+    writeMetric(out, "fifo_high_water", "gauge", "Most frames ever waiting in the sample FIFO.", fifoHighWater.load(std::memory_order_relaxed));
+    writeMetric(out, "fifo_overruns_total", "counter", "Frames dropped because the sample FIFO was full.", fifoOverruns.load(std::memory_order_relaxed));
+    notifyLatency.write(out, "notify_latency_us", "Time to hand one batch to the SSE and WebSocket transports, in microseconds.");
+    writeMetric(out, "heap_free_bytes", "gauge", "Free heap.", ESP.getFreeHeap());
+    writeMetric(out, "heap_min_free_bytes", "gauge", "Lowest free heap since boot.", ESP.getMinFreeHeap());
+    writeMetric(out, "heap_largest_free_block_bytes", "gauge", "Largest allocatable heap block.", ESP.getMaxAllocHeap());
+    writeMetric(out, "async_tcp_queue_depth", "gauge", "Events waiting for the async_tcp task.", async_tcp_queue_depth());
+    writeMetric(out, "loop_iterations_total", "counter", "loop() passes since boot.", loopIterations.load(std::memory_order_relaxed));
+    writeMetric(out, "loop_iterations_per_second", "gauge", "loop() passes during the last full second.", loopRate.load(std::memory_order_relaxed));
+
+    out.print("# HELP " METRICS_PREFIX "stage_busy_ms_total Time each pipeline stage spent working, in milliseconds, by the core it runs on.\n"
+              "# TYPE " METRICS_PREFIX "stage_busy_ms_total counter\n");
+    for (uint8_t stage = 0; stage < STAGE_COUNT; stage++)
+    {
+        out.printf(METRICS_PREFIX "stage_busy_ms_total{stage=\"%s\",core=\"%d\"} %u\n", stageNames[stage], stageCore[stage].load(std::memory_order_relaxed), stageBusyMs[stage].load(std::memory_order_relaxed));
+    }
+}
@@ -0,0 +1,58 @@
+/**
+ * @file Metrics.h
+ * @brief Allocation-free performance counters, reported in the Prometheus text format.
+ *
+ * Every counter is a fixed atomic that the owning task updates in place; nothing on the streaming
+ * path allocates or locks. Only writeMetrics(), called from the /metrics handler, formats text.
+ */
+
+#ifndef Metrics_h
+#define Metrics_h
+
+#include <Arduino.h>
+#include <atomic>
+
+#define METRICS_PREFIX "ekgsim_" ///< Prefix of every metric name.
+#define METRICS_HISTOGRAM_BUCKETS 12 ///< Most finite buckets a LatencyHistogram can have.
+
+/**
+ * @brief Stages of the sample pipeline, each running as its own task.
+ */
+enum PipelineStage : uint8_t
+{
+    STAGE_ACQUIRE,  ///< Knob sampling, InputSampler.
+    STAGE_GENERATE, ///< Waveform synthesis into the sample FIFO.
+    STAGE_ENCODE,   ///< Draining the FIFO, encoding once and queuing on every client.
+    STAGE_COUNT
+};
+
+/**
+ * @class LatencyHistogram
+ * @brief Cumulative latency histogram with fixed microsecond buckets.
+ */
+class LatencyHistogram
+{
+public:
+    LatencyHistogram(const uint32_t *bounds, size_t boundCount);
+
+    void record(uint32_t us); ///< Adds one observation. Single writer only.
+    uint32_t count() const; ///< Number of observations.
+    uint32_t quantile(uint8_t percent) const; ///< Upper bound of the bucket holding the given percentile.
+    void write(Print &out, const char *name, const char *help) const; ///< Prints the histogram in Prometheus format.
+
+private:
+    const uint32_t *_bounds; ///< Ascending upper bound of each bucket in microseconds.
+    size_t _boundCount; ///< Number of finite buckets, at most METRICS_HISTOGRAM_BUCKETS.
+    std::atomic<uint32_t> _buckets[METRICS_HISTOGRAM_BUCKETS + 1]; ///< Per-bucket counts, the one after the last bound is +Inf.
+    std::atomic<uint32_t> _sumUs; ///< Sum of all observations.
+};
+
+void metricsTimerTick(uint32_t periodUs); ///< Records one sample timer callback; periodUs is the programmed period.
+void metricsTimerRestart(); ///< Forgets the previous callback, so a restarted timer's first interval is not counted as jitter.
+void metricsLoopTick(); ///< Records one loop() pass.
+void metricsNotifyLatency(uint32_t us); ///< Records the time taken to hand one batch to the transports.
+void metricsSetFifo(uint32_t depth, uint32_t highWater, uint32_t overruns); ///< Publishes the sample FIFO's state.
+void metricsStageTime(PipelineStage stage, uint32_t us); ///< Adds busy time of a stage. One task per stage.
+void writeMetrics(Print &out); ///< Prints every device-wide metric in Prometheus text format.
+
+#endif
@@ -0,0 +1,102 @@
+/**
+ * @file MulticastStream.cpp
+ * @brief Implementation of the multicast sample stream.
+ */
+
+#include "MulticastStream.h"
+#include "Metrics.h"
+#include <WiFi.h>
+#include <esp_timer.h>
+
+MulticastStream multicastStream;
+
+/**
+ * @brief Opens a UDP socket for sending to the group.
+ *
+ * The socket never joins the group itself and has loopback turned off, so the device does not
+ * receive its own stream.
+ *
+ * @param group Dotted IPv4 address of the multicast group.
+ * @param port Destination UDP port.
+ * @param ttl Router hops a datagram may cross.
+ * @return true if the socket is ready.
+ */
+bool MulticastStream::begin(const char *group, uint16_t port, uint8_t ttl)
+{
+    memset(&_dest, 0, sizeof(_dest));
+    _dest.sin_family = AF_INET;
+    _dest.sin_port = htons(port);
+    if (inet_aton(group, &_dest.sin_addr) == 0)
+    {
+        Serial.printf("Invalid multicast group %s\r\n", group);
+        return false;
+    }
+
+    const int fd = socket(AF_INET, SOCK_DGRAM, IPPROTO_UDP);
+    if (fd < 0)
+    {
+        Serial.println("Failed to open the multicast socket");
+        return false;
+    }
+    const uint8_t hops = ttl;
+    const uint8_t loop = 0;
+    setsockopt(fd, IPPROTO_IP, IP_MULTICAST_TTL, &hops, sizeof(hops));
+    setsockopt(fd, IPPROTO_IP, IP_MULTICAST_LOOP, &loop, sizeof(loop));
+    _socket = fd;
+    Serial.printf("Multicast stream to %s:%u\r\n", group, port);
+    return true;
+}
+
+/**
+ * @brief Sends one batch as a single delta-encoded datagram.
+ *
+ * Never blocks: a datagram lwIP has no buffer for is counted and forgotten, the next batch goes out
+ * as usual. Nothing is sent while the station has no address.
+ *
+ * @param frames The batch.
+ * @param count Frames in the batch, at most NOTIFY_BATCH_MAX.
+ * @param seq Sequence number of the first frame.
+ * @param sampleRate Samples per second.
+ * @param flags STREAM_FLAG_* bits.
+ * @param genUs Device time the first frame was generated.
+ */
+void MulticastStream::send(const SampleFrame *frames, size_t count, uint32_t seq, uint16_t sampleRate, uint8_t flags, uint32_t genUs)
+{
+    if (_socket < 0 || count == 0 || !WiFi.isConnected())
+    {
+        return;
+    }
+    if (count > NOTIFY_BATCH_MAX)
+    {
+        count = NOTIFY_BATCH_MAX;
+    }
+    const size_t length = writeStreamFrameDelta(_buffer, frames, count, seq, sampleRate, flags, genUs, (uint32_t)esp_timer_get_time());
+    if (sendto(_socket, _buffer, length, MSG_DONTWAIT, (const struct sockaddr *)&_dest, sizeof(_dest)) == (ssize_t)length)
+    {
+        _sent.store(_sent.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+        _bytes.store(_bytes.load(std::memory_order_relaxed) + length, std::memory_order_relaxed);
+    }
+    else
+    {
+        _dropped.store(_dropped.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+    }
+}
+
+/**
+ * @brief Prints the send counters, nothing if the stream was never opened.
+ *
+ * @param out Destination, typically an AsyncResponseStream.
+ */
+void MulticastStream::writeMetrics(Print &out) const
+{
+    if (_socket < 0)
+    {
+        return;
+    }
+    out.printf("# HELP " METRICS_PREFIX "multicast_datagrams_total Batches sent to the multicast group.\n# TYPE " METRICS_PREFIX "multicast_datagrams_total counter\n"
+               METRICS_PREFIX "multicast_datagrams_total %u\n", _sent.load(std::memory_order_relaxed));
+    out.printf("# HELP " METRICS_PREFIX "multicast_dropped_total Batches not sent because lwIP had no buffer.\n# TYPE " METRICS_PREFIX "multicast_dropped_total counter\n"
+               METRICS_PREFIX "multicast_dropped_total %u\n", _dropped.load(std::memory_order_relaxed));
+    out.printf("# HELP " METRICS_PREFIX "multicast_bytes_sent_total Bytes in the datagrams sent to the multicast group.\n# TYPE " METRICS_PREFIX "multicast_bytes_sent_total counter\n"
+               METRICS_PREFIX "multicast_bytes_sent_total %u\n", _bytes.load(std::memory_order_relaxed));
+}
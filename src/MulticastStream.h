@@ -0,0 +1,62 @@
+/**
+ * @file MulticastStream.h
+ * @brief Optional UDP multicast copy of the sample stream, for rooms with more monitors than TCP clients.
+ *
+ * Every batch the stream task hands to /ws also goes out once as a single datagram to MULTICAST_GROUP,
+ * a StreamFrameHeader followed by STREAM_ENCODING_DELTA samples, so each datagram decodes on its own.
+ * The device pays for one send per batch however many viewers join the group. Nothing is queued per
+ * receiver and nothing is retransmitted: a receiver orders datagrams by the header's seq and drops any
+ * that arrive after a later one (see scripts/multicast_viewer.py). The group is advertised over mDNS
+ * as MDNS_STREAM_SERVICE once the station is up, see WifiConnection.cpp.
+ */
+
+#ifndef MulticastStream_h
+#define MulticastStream_h
+
+#include <Arduino.h>
+#include <lwip/sockets.h>
+#include <atomic>
+#include "StreamFormat.h"
+
+#ifndef MULTICAST_STREAM
+#define MULTICAST_STREAM 0 ///< 1 sends the multicast stream. Off by default, as it takes airtime with nobody watching.
+#endif
+#ifndef MULTICAST_GROUP
+#define MULTICAST_GROUP "239.255.72.50" ///< Destination group, in the organization-local scope.
+#endif
+#ifndef MULTICAST_PORT
+#define MULTICAST_PORT 47250 ///< Destination UDP port.
+#endif
+#ifndef MULTICAST_TTL
+#define MULTICAST_TTL 1 ///< Router hops; 1 keeps the stream on the local network.
+#endif
+#define MDNS_STREAM_SERVICE "_ekgsim" ///< mDNS service type of the multicast stream, over "_udp".
+
+/**
+ * @class MulticastStream
+ * @brief Sends each batch as one datagram to a multicast group.
+ */
+class MulticastStream
+{
+public:
+    MulticastStream() : _socket(-1), _dest(), _sent(0), _dropped(0), _bytes(0) {} ///< Constructor starts closed.
+
+    bool begin(const char *group = MULTICAST_GROUP, uint16_t port = MULTICAST_PORT, uint8_t ttl = MULTICAST_TTL); ///< Opens the socket; call once from setup().
+    void send(const SampleFrame *frames, size_t count, uint32_t seq, uint16_t sampleRate, uint8_t flags, uint32_t genUs); ///< Sends one batch; stream task only.
+    bool active() const { return _socket >= 0; } ///< Whether begin() succeeded.
+    uint16_t port() const { return ntohs(_dest.sin_port); } ///< Destination port.
+    IPAddress group() const { return IPAddress(_dest.sin_addr.s_addr); } ///< Destination group.
+    void writeMetrics(Print &out) const; ///< Prints the send counters in Prometheus text format.
+
+private:
+    int _socket; ///< UDP socket, -1 until begin().
+    struct sockaddr_in _dest; ///< Group and port every datagram goes to.
+    uint8_t _buffer[sizeof(StreamFrameHeader) + STREAM_DELTA_PAYLOAD_MAX(NOTIFY_BATCH_MAX)]; ///< Datagram being built; stream task only.
+    std::atomic<uint32_t> _sent; ///< Datagrams handed to lwIP.
+    std::atomic<uint32_t> _dropped; ///< Batches lwIP had no room for.
+    std::atomic<uint32_t> _bytes; ///< Bytes in the datagrams sent.
+};
+
+extern MulticastStream multicastStream;
+
+#endif
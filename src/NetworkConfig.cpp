@@ -0,0 +1,72 @@
+/**
+ * @file NetworkConfig.cpp
+ * @brief Loading and saving of the packed network settings record.
+ */
+
+#include "NetworkConfig.h"
+#include "SPIFFSManager.h"
+
+NetworkConfig networkConfig;
+
+/**
+ * @brief Reads a legacy one-value settings file into a record field.
+ * 
+ * @param path The path to the file.
+ * @param field Destination field.
+ * @param size Size of @p field, including the terminator.
+ */
+static void readLegacyField(const char *path, char *field, size_t size)
+{
+    size_t n = readFile(SPIFFS, path, field, size - 1);
+    while (n > 0 && isspace((unsigned char)field[n - 1]))
+    {
+        n--; // Editors like to leave a trailing newline
+    }
+    field[n] = '\0';
+}
+
+/**
+ * @brief Loads the network settings into networkConfig.
+ * 
+ * The record is read with a single file read. If it is missing or from another layout version,
+ * the settings are taken from the old ssid/pass/ip/gateway .txt files instead and saved as a record
+ * so the next boot only needs one read.
+ * 
+ * @return true if the settings came from a valid record.
+ */
+bool loadNetworkConfig()
+{
+    if (readFile(SPIFFS, NETWORK_CONFIG_PATH, &networkConfig, sizeof(networkConfig)) == sizeof(networkConfig)
+        && networkConfig.magic == NETWORK_CONFIG_MAGIC && networkConfig.version == NETWORK_CONFIG_VERSION)
+    {
+        // Never trust the terminators of a record read from flash
+        networkConfig.ssid[sizeof(networkConfig.ssid) - 1] = '\0';
+        networkConfig.pass[sizeof(networkConfig.pass) - 1] = '\0';
+        networkConfig.ip[sizeof(networkConfig.ip) - 1] = '\0';
+        networkConfig.gateway[sizeof(networkConfig.gateway) - 1] = '\0';
+        return true;
+    }
+
+    memset(&networkConfig, 0, sizeof(networkConfig));
+    readLegacyField("/ssid.txt", networkConfig.ssid, sizeof(networkConfig.ssid));
+    readLegacyField("/pass.txt", networkConfig.pass, sizeof(networkConfig.pass));
+    readLegacyField("/ip.txt", networkConfig.ip, sizeof(networkConfig.ip));
+    readLegacyField("/gateway.txt", networkConfig.gateway, sizeof(networkConfig.gateway));
+    if (networkConfig.ssid[0] != '\0')
+    {
+        saveNetworkConfig();
+    }
+    return false;
+}
+
+/**
+ * @brief Saves networkConfig as a single record.
+ * 
+ * @return true if the record was written completely.
+ */
+bool saveNetworkConfig()
+{
+    networkConfig.magic = NETWORK_CONFIG_MAGIC;
+    networkConfig.version = NETWORK_CONFIG_VERSION;
+    return writeFile(SPIFFS, NETWORK_CONFIG_PATH, &networkConfig, sizeof(networkConfig));
+}
@@ -0,0 +1,35 @@
+/**
+ * @file NetworkConfig.h
+ * @brief Network settings kept in one packed record on the filesystem and cached in RAM.
+ */
+
+#ifndef NetworkConfig_h
+#define NetworkConfig_h
+
+#include <Arduino.h>
+
+#define NETWORK_CONFIG_PATH "/netcfg.bin" ///< File holding the packed NetworkConfig record.
+#define NETWORK_CONFIG_MAGIC 0x4E434647UL ///< "NCFG", marks a valid record.
+#define NETWORK_CONFIG_VERSION 1 ///< Layout version of NetworkConfig, bumped on incompatible changes.
+
+/**
+ * @brief Station settings, stored on the filesystem exactly as laid out here.
+ *
+ * Every string is NUL-terminated within its field.
+ */
+struct __attribute__((packed)) NetworkConfig
+{
+    uint32_t magic;   ///< NETWORK_CONFIG_MAGIC.
+    uint8_t version;  ///< NETWORK_CONFIG_VERSION.
+    char ssid[33];    ///< Network name, up to 32 characters.
+    char pass[65];    ///< WPA passphrase, up to 64 characters.
+    char ip[16];      ///< Static IPv4 address in dotted form.
+    char gateway[16]; ///< Gateway IPv4 address in dotted form.
+};
+
+extern NetworkConfig networkConfig; ///< Settings loaded by loadNetworkConfig().
+
+bool loadNetworkConfig(); ///< Fills networkConfig from the record, migrating the .txt files if there is none.
+bool saveNetworkConfig(); ///< Writes networkConfig back as a single record.
+
+#endif
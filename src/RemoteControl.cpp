@@ -0,0 +1,188 @@
+/**
+ * @file RemoteControl.cpp
+ * @brief Implementation of the remote parameter block and the scenario player.
+ */
+
+#include "RemoteControl.h"
+
+RemoteControl remoteControl;
+
+/**
+ * @brief Constructs a block with no overrides and no scenario.
+ */
+RemoteControl::RemoteControl()
+    : _overrides(0), _modes(0), _state(0), _publishedTable(0), _publishedCount(0), _publishedLoopAt(0), _published(0), _accepted(0),
+      _playing(nullptr), _loopAt(0), _clock(0), _playingCount(0), _playingNext(0)
+{
+}
+
+/**
+ * @brief Applies one ControlSet.
+ *
+ * BPM and gain take effect on the producer's next tick. Mode changes wait for the next beat, so a
+ * trace never switches rhythm halfway through one; a later change of the same mode replaces an
+ * earlier one that has not been applied yet.
+ *
+ * @param control The change; values out of range are clamped.
+ */
+void RemoteControl::apply(const ControlSet &control)
+{
+    // The web server and a playing scenario both apply changes, so each word is updated in place
+    uint32_t mask = 0;
+    uint32_t value = 0;
+    if (control.set & CONTROL_SET_BPM)
+    {
+        mask |= 0xFF;
+        value |= control.bpm ? constrain(control.bpm, BPM_MIN, BPM_MAX) : 0;
+    }
+    if (control.set & CONTROL_SET_AMP)
+    {
+        mask |= 0xFF00;
+        value |= (uint32_t)(control.amp ? constrain(control.amp, AMP_MIN, AMP_MAX) : 0) << 8;
+    }
+    uint32_t current = _overrides.load(std::memory_order_relaxed);
+    while (mask && !_overrides.compare_exchange_weak(current, (current & ~mask) | value, std::memory_order_relaxed))
+    {
+    }
+
+    const uint32_t modes = control.set & (CONTROL_SET_EKG | CONTROL_SET_ALIVE | CONTROL_SET_RHYTHM);
+    uint32_t valueMask = ((modes & (CONTROL_SET_EKG | CONTROL_SET_ALIVE)) >> 2) << 8;
+    if (modes & CONTROL_SET_RHYTHM)
+    {
+        valueMask |= 0xFF0000;
+    }
+    const uint32_t values = ((uint32_t)control.state << 8) | ((uint32_t)control.rhythm << 16);
+    current = _modes.load(std::memory_order_relaxed);
+    while (modes && !_modes.compare_exchange_weak(current, (current & ~valueMask) | modes | (values & valueMask), std::memory_order_relaxed))
+    {
+    }
+}
+
+/**
+ * @brief Copies a compiled scenario into the spare table and hands it to the producer.
+ *
+ * The producer switches to it on its next tick and starts at sample 0. An upload that arrives
+ * before it has done so is refused rather than overwrite a table it is about to read.
+ *
+ * @param steps Steps in ascending atSample order, or nullptr with @p count 0 to stop.
+ * @param count Number of steps; anything above SCENARIO_MAX_STEPS is ignored.
+ * @param loopAt Sample at which the scenario starts over, 0 to play it once.
+ * @return false if the previous upload has not been picked up yet.
+ */
+bool RemoteControl::loadScenario(const ScenarioStep *steps, size_t count, uint32_t loopAt)
+{
+    const uint32_t published = _published.load(std::memory_order_relaxed);
+    if (_accepted.load(std::memory_order_acquire) != published)
+    {
+        return false;
+    }
+    if (count > SCENARIO_MAX_STEPS)
+    {
+        count = SCENARIO_MAX_STEPS;
+    }
+    const uint8_t table = _publishedTable ^ 1; // The producer only ever reads the last published table
+    memcpy(_tables[table], steps, count * sizeof(ScenarioStep));
+    _publishedTable = table;
+    _publishedCount = count;
+    _publishedLoopAt = loopAt;
+    _published.store(published + 1, std::memory_order_release);
+    return true;
+}
+
+/**
+ * @brief The BPM and gain overrides in effect; a field is 0 where the knob rules.
+ */
+ControlSet RemoteControl::overrides() const
+{
+    const uint32_t overrides = _overrides.load(std::memory_order_relaxed);
+    ControlSet control = { 0, 0, (uint8_t)overrides, (uint8_t)(overrides >> 8), 0 };
+    return control;
+}
+
+/**
+ * @brief Picks up a new scenario, moves the clock on and applies every step that is due.
+ *
+ * @param samples Samples about to be produced.
+ */
+void RemoteControl::advance(uint32_t samples)
+{
+    const uint32_t published = _published.load(std::memory_order_acquire);
+    uint16_t next = _playingNext.load(std::memory_order_relaxed);
+    uint16_t count = _playingCount.load(std::memory_order_relaxed);
+    if (published != _accepted.load(std::memory_order_relaxed))
+    {
+        _playing = _tables[_publishedTable];
+        count = _publishedCount;
+        _loopAt = _publishedLoopAt;
+        _clock = 0;
+        next = 0;
+        _playingCount.store(count, std::memory_order_relaxed);
+        _accepted.store(published, std::memory_order_release);
+    }
+    if (count == 0)
+    {
+        return;
+    }
+
+    while (next < count && _playing[next].atSample <= _clock)
+    {
+        apply(_playing[next++].control);
+    }
+    _clock += samples;
+    if (next == count)
+    {
+        if (_loopAt == 0)
+        {
+            count = 0; // Played out; what the last step set stays in effect
+            _playingCount.store(count, std::memory_order_relaxed);
+        }
+        else if (_clock >= _loopAt)
+        {
+            _clock -= _loopAt;
+            next = 0;
+        }
+    }
+    _playingNext.store(next, std::memory_order_relaxed);
+}
+
+/**
+ * @brief Replaces the knob readings with the remote overrides, read together in one load.
+ *
+ * @param bpm Knob heart rate in, heart rate to use out.
+ * @param amp Knob amplification in, amplification to use out.
+ */
+void RemoteControl::parameters(int32_t &bpm, int32_t &amp) const
+{
+    const uint32_t overrides = _overrides.load(std::memory_order_relaxed);
+    if (overrides & 0xFF)
+    {
+        bpm = overrides & 0xFF;
+    }
+    if (overrides & 0xFF00)
+    {
+        amp = (overrides >> 8) & 0xFF;
+    }
+}
+
+/**
+ * @brief Takes the mode changes requested since the last call.
+ *
+ * @param state Receives the CONTROL_EKG and CONTROL_ALIVE values.
+ * @param rhythm Receives the rhythm, valid with CONTROL_SET_RHYTHM.
+ * @return CONTROL_SET_EKG, CONTROL_SET_ALIVE and CONTROL_SET_RHYTHM bits of the changes that apply, 0 if none.
+ */
+uint8_t RemoteControl::takeModes(uint8_t &state, uint8_t &rhythm)
+{
+    const uint32_t modes = _modes.exchange(0, std::memory_order_relaxed);
+    state = modes >> 8;
+    rhythm = modes >> 16;
+    return modes & 0xFF;
+}
+
+/**
+ * @brief Records the parameters the producer is generating with, for the control API to report.
+ */
+void RemoteControl::publish(uint16_t bpm, uint16_t amp, uint8_t state, uint8_t rhythm)
+{
+    _state.store((bpm & 0xFF) | ((uint32_t)(amp & 0xFF) << 8) | ((uint32_t)state << 16) | ((uint32_t)rhythm << 24), std::memory_order_relaxed);
+}
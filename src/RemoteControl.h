@@ -0,0 +1,103 @@
+/**
+ * @file RemoteControl.h
+ * @brief Parameter block for remote control of the generator, and the scenario player.
+ *
+ * The web server writes BPM and gain overrides into one atomic word, so the producer task always
+ * reads a consistent pair with a single load, and mode changes into another that the producer
+ * drains at the next beat boundary, like the buttons. A scenario is a table of ControlSets stamped
+ * with the sample they are due at. It is compiled once on upload and handed to the producer by
+ * publishing one of two tables, so playing it back is a compare per sample.
+ */
+
+#ifndef RemoteControl_h
+#define RemoteControl_h
+
+#include <Arduino.h>
+#include <atomic>
+
+#define BPM_MIN 40  ///< Slowest heart rate, at the bottom of the BPM knob.
+#define BPM_MAX 220 ///< Fastest heart rate, at the top of the BPM knob.
+#define AMP_MIN 10  ///< Smallest ECG amplification in percent, at the bottom of the amplitude knob.
+#define AMP_MAX 200 ///< Largest ECG amplification in percent, at the top of the amplitude knob.
+
+#ifndef SCENARIO_MAX_STEPS
+#define SCENARIO_MAX_STEPS 128 ///< Steps one scenario can hold.
+#endif
+
+#define CONTROL_SET_BPM 0x01   ///< ControlSet::set bit: bpm applies.
+#define CONTROL_SET_AMP 0x02   ///< ControlSet::set bit: amp applies.
+#define CONTROL_SET_EKG 0x04   ///< ControlSet::set bit: the CONTROL_EKG bit of state applies.
+#define CONTROL_SET_ALIVE 0x08 ///< ControlSet::set bit: the CONTROL_ALIVE bit of state applies.
+#define CONTROL_SET_RHYTHM 0x10 ///< ControlSet::set bit: rhythm applies.
+#define CONTROL_EKG 0x01       ///< ControlSet::state bit: EKG rather than ARY.
+#define CONTROL_ALIVE 0x02     ///< ControlSet::state bit: the patient is alive.
+
+static_assert(CONTROL_SET_EKG >> 2 == CONTROL_EKG && CONTROL_SET_ALIVE >> 2 == CONTROL_ALIVE, "each mode's set bit is its state bit shifted by 2");
+
+/**
+ * @brief One change of the generator's parameters; fields whose CONTROL_SET_* bit is clear are left alone.
+ */
+struct ControlSet
+{
+    uint8_t set;   ///< CONTROL_SET_* bits.
+    uint8_t state; ///< CONTROL_EKG and CONTROL_ALIVE values.
+    uint8_t bpm;   ///< Heart rate, BPM_MIN to BPM_MAX, or 0 to hand it back to the knob.
+    uint8_t amp;   ///< ECG amplification in percent, AMP_MIN to AMP_MAX, or 0 to hand it back to the knob.
+    uint8_t rhythm; ///< WavePack table index plus 1 to play as the ECG, or 0 for the built-in EKG or ARY.
+};
+
+/**
+ * @brief A ControlSet and the sample it is due at, counted from the start of the scenario.
+ */
+struct ScenarioStep
+{
+    uint32_t atSample; ///< Samples since the scenario started.
+    ControlSet control; ///< What changes.
+};
+
+/**
+ * @class RemoteControl
+ * @brief Overrides of the front panel, written by the web server and read by the producer task.
+ */
+class RemoteControl
+{
+public:
+    RemoteControl();
+
+    // Web server
+    void apply(const ControlSet &control); ///< Overrides the knobs and queues mode changes for the next beat.
+    bool loadScenario(const ScenarioStep *steps, size_t count, uint32_t loopAt); ///< Starts playing a compiled scenario.
+    bool stopScenario() { return loadScenario(nullptr, 0, 0); } ///< Stops the scenario; overrides it made stay.
+    ControlSet overrides() const; ///< BPM and gain overrides, 0 where the knob rules.
+    uint32_t state() const { return _state.load(std::memory_order_relaxed); } ///< What the producer last used, see publish().
+    uint16_t scenarioSteps() const { return _playingCount.load(std::memory_order_relaxed); } ///< Steps of the scenario playing, 0 if none.
+    uint16_t scenarioNext() const { return _playingNext.load(std::memory_order_relaxed); } ///< Index of its next step to apply.
+
+    // Producer task only
+    void advance(uint32_t samples); ///< Moves the scenario clock on and applies the steps that came due.
+    void parameters(int32_t &bpm, int32_t &amp) const; ///< Replaces the knob values with any overrides.
+    uint8_t takeModes(uint8_t &state, uint8_t &rhythm); ///< Returns the CONTROL_SET_EKG/ALIVE/RHYTHM bits requested since the last call.
+    void publish(uint16_t bpm, uint16_t amp, uint8_t state, uint8_t rhythm); ///< Records the parameters in use, for state().
+
+private:
+    std::atomic<uint32_t> _overrides; ///< bpm in bits 0-7, amp in bits 8-15.
+    std::atomic<uint32_t> _modes; ///< Pending CONTROL_SET_* bits in bits 0-7, their state in bits 8-15, rhythm in bits 16-23.
+    std::atomic<uint32_t> _state; ///< bpm in bits 0-7, amp in bits 8-15, state in bits 16-23, rhythm in bits 24-31.
+
+    ScenarioStep _tables[2][SCENARIO_MAX_STEPS]; ///< Playing table and the one the next upload is compiled into.
+    uint8_t _publishedTable; ///< Table of the last upload; written before _published.
+    uint16_t _publishedCount; ///< Steps in it; written before _published.
+    uint32_t _publishedLoopAt; ///< Its loop length in samples, 0 to play once; written before _published.
+    std::atomic<uint32_t> _published; ///< Bumped on every upload.
+    std::atomic<uint32_t> _accepted; ///< Last _published the producer switched to.
+
+    const ScenarioStep *_playing; ///< Table being played; producer only.
+    uint32_t _loopAt; ///< Loop length of the scenario playing; producer only.
+    uint32_t _clock; ///< Samples since the scenario started; producer only.
+    std::atomic<uint16_t> _playingCount; ///< Steps of the scenario playing.
+    std::atomic<uint16_t> _playingNext; ///< Index of its next step.
+};
+
+extern RemoteControl remoteControl;
+
+#endif
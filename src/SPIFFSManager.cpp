@@ -21,9 +21,34 @@ void initSPIFFS()
     Serial.println("SPIFFS mounted successfully");
 }
 
+/**
+ * @brief Reads a file into a caller-supplied buffer in a single read.
+ * 
+ * @param fs The file system object.
+ * @param path The path to the file.
+ * @param buffer Destination for the file content.
+ * @param length Size of @p buffer; a longer file is truncated to it.
+ * @return The number of bytes read, 0 if the file could not be opened.
+ */
+size_t readFile(fs::FS &fs, const char *path, void *buffer, size_t length)
+{
+    File file = fs.open(path);
+    if (!file || file.isDirectory())
+    {
+        Serial.printf("Reading file: %s\r\n- failed to open file for reading\r\n", path);
+        return 0;
+    }
+
+    size_t size = file.size();
+    return file.read((uint8_t *)buffer, size < length ? size : length);
+}
+
 /**
  * @brief Reads the content of a file from the file system.
  * 
+ * The String is sized from file.size() up front, and the data is read in blocks, so it is
+ * allocated once no matter how long the file is.
+ * 
  * @param fs The file system object.
  * @param path The path to the file.
  * @return The content of the file as a String.
@@ -40,13 +65,37 @@ String readFile(fs::FS &fs, const char *path)
     }
 
     String fileContent;
-    while (file.available())
+    fileContent.reserve(file.size());
+    char block[128];
+    size_t n;
+    while ((n = file.read((uint8_t *)block, sizeof(block) - 1)) > 0)
     {
-        fileContent += char(file.read());
+        block[n] = '\0';
+        fileContent += block;
     }
     return fileContent;
 }
 
+/**
+ * @brief Writes a block of binary data to a file, replacing its content.
+ * 
+ * @param fs The file system object to use for file operations.
+ * @param path The path of the file to write to.
+ * @param data The data to write.
+ * @param length Number of bytes in @p data.
+ * @return true if every byte was written.
+ */
+bool writeFile(fs::FS &fs, const char *path, const void *data, size_t length)
+{
+    File file = fs.open(path, FILE_WRITE);
+    if (!file)
+    {
+        Serial.printf("Writing file: %s\r\n- failed to open file for writing\r\n", path);
+        return false;
+    }
+    return file.write((const uint8_t *)data, length) == length;
+}
+
 /**
  * @brief Writes a message to a file.
  * 
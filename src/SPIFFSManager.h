@@ -6,7 +6,9 @@
 #include "SPIFFS.h"
 
 void initSPIFFS();
+size_t readFile(fs::FS &fs, const char *path, void *buffer, size_t length);
 String readFile(fs::FS &fs, const char *path);
+bool writeFile(fs::FS &fs, const char *path, const void *data, size_t length);
 void writeFile(fs::FS &fs, const char *path, const char *message);
 
 #endif
@@ -0,0 +1,44 @@
+/**
+ * @file SampleFrame.h
+ * @brief One tick of samples across every simulated monitor channel.
+ */
+
+#ifndef SampleFrame_h
+#define SampleFrame_h
+
+#include <Arduino.h>
+
+/**
+ * @brief Channels carried in every SampleFrame, in wire order.
+ */
+enum Channel : uint8_t
+{
+    CHANNEL_ECG,   ///< ECG lead, switchable between EKG and ARY.
+    CHANNEL_PLETH, ///< SpO2 plethysmograph, locked to the heart rate.
+    CHANNEL_RESP,  ///< Respiration, at its own rate.
+    CHANNEL_COUNT
+};
+
+/**
+ * @brief Sample-aligned values of all channels for one tick.
+ *
+ * Frames are stored and sent back to back, so a block of frames is the interleaved layout
+ * ECG, PLETH, RESP, ECG, PLETH, RESP, ... on the wire.
+ */
+struct SampleFrame
+{
+    uint8_t ch[CHANNEL_COUNT]; ///< One value per Channel.
+};
+
+static_assert(sizeof(SampleFrame) == CHANNEL_COUNT, "SampleFrame must stay tightly packed for the wire format");
+
+/**
+ * @brief A SampleFrame as it travels through the FIFO, with the time it was generated.
+ */
+struct StampedFrame
+{
+    SampleFrame frame; ///< The samples.
+    uint32_t stampUs;  ///< Low 32 bits of esp_timer_get_time() when the frame was generated.
+};
+
+#endif
@@ -0,0 +1,121 @@
+/**
+ * @file SampleHistory.cpp
+ * @brief Implementation of the sample history ring.
+ */
+
+#include "SampleHistory.h"
+
+SampleHistory sampleHistory;
+
+static constexpr uint32_t HISTORY_MASK = HISTORY_CAPACITY - 1;
+// Frames the writer may be overwriting are out of bounds; keep a batch's worth of slack
+static constexpr uint32_t HISTORY_SAFE = HISTORY_CAPACITY - HISTORY_REPLAY_MAX / 2;
+
+/**
+ * @brief Appends a batch of frames; sequence numbers are contiguous, so the batch goes at head().
+ *
+ * @param frames Frames to add, oldest first.
+ * @param count Number of frames.
+ */
+void SampleHistory::append(const SampleFrame *frames, size_t count)
+{
+    const uint32_t head = _head.load(std::memory_order_relaxed);
+    for (size_t i = 0; i < count; i++)
+    {
+        _frames[(head + i) & HISTORY_MASK] = frames[i];
+    }
+    _head.store(head + count, std::memory_order_release);
+}
+
+/**
+ * @brief Frames from sequence number @p from up to @p head that are safe to read.
+ *
+ * When @p from is older than the history, or not a sequence number seen yet, that is everything from
+ * the oldest frame still safe to read on.
+ */
+static uint32_t backlog(uint32_t head, uint32_t from)
+{
+    const uint32_t available = head - from;
+    if (available > head || available > HISTORY_SAFE)
+    {
+        return head < HISTORY_SAFE ? head : HISTORY_SAFE; // from is in the future or too old
+    }
+    return available;
+}
+
+/**
+ * @brief Copies the newest frames from sequence number @p from up to head(), at most @p maxCount of them.
+ *
+ * When @p from is older than the history, or not a sequence number seen yet, the copy starts at the
+ * oldest frame still safe to read. When more than @p maxCount frames are due only the newest are copied.
+ *
+ * @param from Sequence number of the first frame wanted.
+ * @param out Destination with room for @p maxCount frames.
+ * @param maxCount Most frames to copy, at most HISTORY_REPLAY_MAX.
+ * @param first Receives the sequence number of out[0].
+ * @return Number of frames copied.
+ */
+size_t SampleHistory::read(uint32_t from, SampleFrame *out, size_t maxCount, uint32_t &first) const
+{
+    const uint32_t head = _head.load(std::memory_order_acquire);
+    uint32_t available = backlog(head, from);
+    if (available > maxCount)
+    {
+        available = maxCount;
+    }
+    first = head - available;
+    return copy(head, out, available, first);
+}
+
+/**
+ * @brief Copies the oldest frames from sequence number @p from on, at most @p maxCount of them.
+ *
+ * Reading a long backlog in chunks this way keeps each chunk small; @p from is clamped like in read().
+ *
+ * @param from Sequence number of the first frame wanted.
+ * @param out Destination with room for @p maxCount frames.
+ * @param maxCount Most frames to copy.
+ * @param first Receives the sequence number of out[0].
+ * @return Number of frames copied.
+ */
+size_t SampleHistory::readFrom(uint32_t from, SampleFrame *out, size_t maxCount, uint32_t &first) const
+{
+    const uint32_t head = _head.load(std::memory_order_acquire);
+    const uint32_t available = backlog(head, from);
+    first = head - available;
+    return copy(head, out, available < maxCount ? available : maxCount, first);
+}
+
+/**
+ * @brief Copies @p count frames from sequence number @p first on, then drops any the writer lapped meanwhile.
+ *
+ * @param head head() when @p first was worked out; the frames must lie within HISTORY_SAFE of it.
+ * @param out Destination with room for @p count frames.
+ * @param count Frames to copy.
+ * @param first Sequence number of the first frame; moved past whatever was dropped.
+ * @return Number of frames left in @p out.
+ */
+size_t SampleHistory::copy(uint32_t head, SampleFrame *out, size_t count, uint32_t &first) const
+{
+    for (uint32_t i = 0; i < count; i++)
+    {
+        out[i] = _frames[(first + i) & HISTORY_MASK];
+    }
+
+    // Seqlock read side: the copy above must not be reordered past the second look at the head
+    std::atomic_thread_fence(std::memory_order_acquire);
+    const uint32_t lapped = _head.load(std::memory_order_relaxed) - head;
+    const uint32_t age = head - first;
+    if (lapped > HISTORY_SAFE - age)
+    {
+        const uint32_t stale = lapped - (HISTORY_SAFE - age);
+        if (stale >= count)
+        {
+            return 0;
+        }
+        memmove(out, out + stale, (count - stale) * sizeof(SampleFrame));
+        first += stale;
+        count -= stale;
+    }
+    return count;
+}
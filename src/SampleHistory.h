@@ -0,0 +1,56 @@
+/**
+ * @file SampleHistory.h
+ * @brief Preallocated history of the most recent frames, indexed by sequence number.
+ *
+ * The stream task appends every batch, in sequence order, before it is broadcast. The web server
+ * reads from it to send a joining client what it missed: on the async_tcp task in one message for
+ * /ws, and on the stream task in NOTIFY_BATCH_MAX chunks, paced by the client's queue, for /events.
+ * There is one writer and no lock. Unlike an SpscRing, whose reader never touches a slot the writer
+ * may be filling, a reader here can race the writer over old slots, so reads work like the read side
+ * of a seqlock: copy, an acquire fence, then look at the head again and drop whatever the writer may
+ * have overwritten meanwhile. The oldest HISTORY_REPLAY_MAX / 2 slots, where the next batch goes,
+ * are never read, which covers the batch being written before the head moves past it.
+ */
+
+#ifndef SampleHistory_h
+#define SampleHistory_h
+
+#include <Arduino.h>
+#include <atomic>
+#include "SampleFrame.h"
+
+#ifndef HISTORY_CAPACITY
+#define HISTORY_CAPACITY 2048 ///< Frames kept, a power of two; about 8 s at 250 Hz.
+#endif
+
+#ifndef HISTORY_REPLAY_MAX
+#define HISTORY_REPLAY_MAX 1024 ///< Frames replayed to a new client, one screen of the page's sweep (POINTS_LOOP), and most a /ws client gets.
+#endif
+
+static_assert((HISTORY_CAPACITY & (HISTORY_CAPACITY - 1)) == 0, "HISTORY_CAPACITY must be a power of two");
+static_assert(HISTORY_REPLAY_MAX < HISTORY_CAPACITY, "replays must leave room for the writer");
+
+/**
+ * @class SampleHistory
+ * @brief Ring of the last HISTORY_CAPACITY frames, addressed by their sequence number.
+ */
+class SampleHistory
+{
+public:
+    SampleHistory() : _head(0) {} ///< Constructor starts empty at sequence number 0.
+
+    void append(const SampleFrame *frames, size_t count); ///< Adds frames. Single writer only.
+    size_t read(uint32_t from, SampleFrame *out, size_t maxCount, uint32_t &first) const; ///< Copies the newest frames from @p from on.
+    size_t readFrom(uint32_t from, SampleFrame *out, size_t maxCount, uint32_t &first) const; ///< Copies the oldest frames from @p from on.
+    uint32_t head() const { return _head.load(std::memory_order_acquire); } ///< Sequence number of the next frame to be appended.
+
+private:
+    size_t copy(uint32_t head, SampleFrame *out, size_t count, uint32_t &first) const; ///< Copies frames, dropping any lapped meanwhile.
+
+    SampleFrame _frames[HISTORY_CAPACITY]; ///< Frame seq lives at _frames[seq % HISTORY_CAPACITY].
+    std::atomic<uint32_t> _head; ///< Next sequence number, published after the frames are written.
+};
+
+extern SampleHistory sampleHistory;
+
+#endif
@@ -0,0 +1,59 @@
+/**
+ * @file SoakReport.cpp
+ * @brief Implementation of the soak report.
+ */
+
+#include "SoakReport.h"
+#include "WiFiWebServer.h"
+
+#if SOAK_REPORT_INTERVAL_MS
+
+static unsigned long lastReportTime = 0; ///< millis() of the previous report.
+static uint32_t lastFrames = 0; ///< framesStreamed at the previous report.
+static uint32_t lastOverruns = 0; ///< fifoOverruns at the previous report.
+static int32_t heapBaseline = -1; ///< Free heap once the warm-up has passed, -1 before that.
+
+/**
+ * @brief Prints one line with the rates over the last interval and the heap state.
+ *
+ * The heap drift is measured against the free heap right after SOAK_WARMUP_MS, when the
+ * clients and their buffers are in place; a steady downward drift over hours is a leak.
+ *
+ * @param framesStreamed Frames handed to the transports since boot.
+ * @param fifoOverruns Frames the producer could not queue since boot.
+ */
+void soakReportTick(uint32_t framesStreamed, uint32_t fifoOverruns)
+{
+    const unsigned long now = millis();
+    if (now - lastReportTime < SOAK_REPORT_INTERVAL_MS)
+    {
+        return;
+    }
+    const uint32_t elapsed = now - lastReportTime;
+    const uint32_t frames = framesStreamed - lastFrames;
+    const uint32_t overruns = fifoOverruns - lastOverruns;
+    lastReportTime = now;
+    lastFrames = framesStreamed;
+    lastOverruns = fifoOverruns;
+
+    const int32_t freeHeap = ESP.getFreeHeap();
+    if (heapBaseline < 0 && now >= SOAK_WARMUP_MS)
+    {
+        heapBaseline = freeHeap;
+    }
+
+    Serial.printf("soak t=%lus sse=%u ws=%u frames/s=%.1f drop=%.3f%% heap=%d drift=%d min=%u largest=%u\r\n",
+                  now / 1000, (unsigned)events.count(), (unsigned)ws.count(),
+                  frames * 1000.0f / elapsed,
+                  frames + overruns ? overruns * 100.0f / (frames + overruns) : 0.0f,
+                  freeHeap, heapBaseline < 0 ? 0 : freeHeap - heapBaseline,
+                  ESP.getMinFreeHeap(), ESP.getMaxAllocHeap());
+}
+
+#else
+
+void soakReportTick(uint32_t framesStreamed, uint32_t fifoOverruns)
+{
+}
+
+#endif
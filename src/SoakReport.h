@@ -0,0 +1,25 @@
+/**
+ * @file SoakReport.h
+ * @brief Periodic serial report for long soak runs of the streaming pipeline.
+ *
+ * Built in by the esp32dev_soak environment. Clients are driven from the host with
+ * scripts/soak_clients.py, which reports what they actually received; this side reports what
+ * the device sustained and how its heap moved.
+ */
+
+#ifndef SoakReport_h
+#define SoakReport_h
+
+#include <Arduino.h>
+
+#ifndef SOAK_REPORT_INTERVAL_MS
+#define SOAK_REPORT_INTERVAL_MS 0 ///< Interval between soak reports in milliseconds, 0 leaves them out.
+#endif
+
+#ifndef SOAK_WARMUP_MS
+#define SOAK_WARMUP_MS 60000 ///< Time allowed for clients to connect before the heap baseline is taken.
+#endif
+
+void soakReportTick(uint32_t framesStreamed, uint32_t fifoOverruns); ///< Prints a report when one is due.
+
+#endif
@@ -0,0 +1,131 @@
+/**
+ * @file SpscRing.h
+ * @brief Lock-free single-producer/single-consumer ring buffer.
+ *
+ * The producer (typically an ISR or a high-priority task) only ever writes the head index and the
+ * consumer only ever writes the tail index, so no locks or critical sections are needed. Indices run
+ * freely and are masked on access, which requires a power-of-two capacity but avoids any division.
+ */
+
+#ifndef SpscRing_h
+#define SpscRing_h
+
+#include <Arduino.h>
+#include <atomic>
+
+/**
+ * @class SpscRing
+ * @brief Fixed-capacity FIFO that is safe to share between exactly one producer and one consumer.
+ *
+ * @tparam T Element type; copied by value.
+ * @tparam Capacity Number of slots, must be a power of two.
+ */
+template <typename T, size_t Capacity>
+class SpscRing
+{
+    static_assert(Capacity > 0 && (Capacity & (Capacity - 1)) == 0, "SpscRing capacity must be a power of two");
+
+public:
+    SpscRing() : head(0), tail(0), overrunCount(0), underrunCount(0), highWaterMark(0) {} ///< Constructor initializes an empty ring.
+
+    /**
+     * @brief Adds an element to the ring. Producer side only.
+     *
+     * Always inlined so that it ends up in the caller's IRAM section when called from an ISR.
+     *
+     * @param item The element to add.
+     * @return true if the element was stored, false if the ring was full (counted as an overrun).
+     */
+    inline __attribute__((always_inline)) bool enqueue(const T &item)
+    {
+        const uint32_t h = head.load(std::memory_order_relaxed);
+        const uint32_t used = h - tail.load(std::memory_order_acquire);
+        if (used >= Capacity)
+        {
+            overrunCount.store(overrunCount.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+            return false; // Overflow, unable to enqueue
+        }
+        buffer[h & mask] = item;
+        head.store(h + 1, std::memory_order_release);
+        if (used >= highWaterMark.load(std::memory_order_relaxed))
+        {
+            highWaterMark.store(used + 1, std::memory_order_relaxed);
+        }
+        return true;
+    }
+
+    /**
+     * @brief Removes the oldest element from the ring. Consumer side only.
+     *
+     * @param item Receives the element.
+     * @return true if an element was removed, false if the ring was empty (counted as an underrun).
+     */
+    bool dequeue(T &item)
+    {
+        const uint32_t t = tail.load(std::memory_order_relaxed);
+        if (head.load(std::memory_order_acquire) == t)
+        {
+            underrunCount.store(underrunCount.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+            return false; // Underflow, unable to dequeue
+        }
+        item = buffer[t & mask];
+        tail.store(t + 1, std::memory_order_release);
+        return true;
+    }
+
+    /**
+     * @brief Removes up to @p maxCount of the oldest elements in one pass. Consumer side only.
+     *
+     * @param out Destination array with room for at least @p maxCount elements.
+     * @param maxCount Maximum number of elements to remove.
+     * @return The number of elements copied into @p out; 0 is counted as an underrun.
+     */
+    size_t dequeue(T *out, size_t maxCount)
+    {
+        const uint32_t t = tail.load(std::memory_order_relaxed);
+        size_t available = head.load(std::memory_order_acquire) - t;
+        if (available == 0)
+        {
+            underrunCount.store(underrunCount.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+            return 0;
+        }
+        if (available > maxCount)
+        {
+            available = maxCount;
+        }
+        for (size_t i = 0; i < available; i++)
+        {
+            out[i] = buffer[(t + i) & mask];
+        }
+        tail.store(t + available, std::memory_order_release);
+        return available;
+    }
+
+    bool isEmpty() const ///< Checks if the ring is empty.
+    {
+        return head.load(std::memory_order_acquire) == tail.load(std::memory_order_acquire);
+    }
+
+    size_t size() const ///< Number of elements currently queued; exact only from the producer or consumer side.
+    {
+        return head.load(std::memory_order_acquire) - tail.load(std::memory_order_acquire);
+    }
+
+    static constexpr size_t capacity() { return Capacity; } ///< Number of slots in the ring.
+
+    uint32_t overruns() const { return overrunCount.load(std::memory_order_relaxed); } ///< Enqueues rejected because the ring was full.
+    uint32_t underruns() const { return underrunCount.load(std::memory_order_relaxed); } ///< Dequeues that found the ring empty.
+    uint32_t highWater() const { return highWaterMark.load(std::memory_order_relaxed); } ///< Most elements ever queued at once.
+
+private:
+    static constexpr uint32_t mask = Capacity - 1;
+
+    T buffer[Capacity]; ///< Storage for the ring.
+    std::atomic<uint32_t> head; ///< Free-running index of the next slot to write, owned by the producer.
+    std::atomic<uint32_t> tail; ///< Free-running index of the next slot to read, owned by the consumer.
+    std::atomic<uint32_t> overrunCount; ///< Written by the producer only.
+    std::atomic<uint32_t> underrunCount; ///< Written by the consumer only.
+    std::atomic<uint32_t> highWaterMark; ///< Written by the producer only.
+};
+
+#endif
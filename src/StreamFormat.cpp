@@ -0,0 +1,218 @@
+/**
+ * @file StreamFormat.cpp
+ * @brief Allocation-free formatting of SSE event records and binary /ws frames.
+ */
+
+#include "StreamFormat.h"
+
+/**
+ * @brief Copies a NUL-terminated string into an event record.
+ * 
+ * @param p Write position in the record.
+ * @param str String to append, without its terminator.
+ * @return The new write position.
+ */
+char *appendString(char *p, const char *str)
+{
+    while (*str)
+    {
+        *p++ = *str++;
+    }
+    return p;
+}
+
+/**
+ * @brief Formats an unsigned integer in decimal into an event record.
+ * 
+ * @param p Write position in the record.
+ * @param val Value to append.
+ * @return The new write position.
+ */
+char *appendUInt(char *p, uint32_t val)
+{
+    char digits[10];
+    int n = 0;
+    do
+    {
+        digits[n++] = '0' + (val % 10);
+        val /= 10;
+    } while (val);
+    while (n)
+    {
+        *p++ = digits[--n];
+    }
+    return p;
+}
+
+/**
+ * @brief Writes the "id:" and "event:" lines and the start of the "data:" line of an event record.
+ * 
+ * @param p Write position in the record.
+ * @param event Event name.
+ * @param id Event id.
+ * @return The new write position, where the data payload goes.
+ */
+char *beginRecord(char *p, const char *event, uint32_t id)
+{
+    p = appendString(p, "id: ");
+    p = appendUInt(p, id);
+    p = appendString(p, "\r\nevent: ");
+    p = appendString(p, event);
+    return appendString(p, "\r\ndata: ");
+}
+
+/**
+ * @brief Terminates the data line and the event record.
+ * 
+ * @param p Write position just past the data payload.
+ * @return The write position just past the record.
+ */
+char *endRecord(char *p)
+{
+    return appendString(p, "\r\n\r\n");
+}
+
+/**
+ * @brief Formats a block of frames as the payload of a "values" event.
+ * 
+ * Produces one array per channel, {"ch":[[ecg...],[pleth...],[resp...]]}. Decimated blocks add
+ * "dt", the number of sample periods each value stands for, so the page keeps its time base.
+ * 
+ * @param p Write position in the record.
+ * @param frames Frames to format, oldest first.
+ * @param count Number of frames, at most NOTIFY_BATCH_MAX.
+ * @param ticksPerValue Sample periods per frame, 1 for the full-rate stream.
+ * @return The new write position.
+ */
+char *appendValues(char *p, const SampleFrame *frames, size_t count, uint8_t ticksPerValue)
+{
+    p = appendString(p, "{");
+    if (ticksPerValue > 1)
+    {
+        p = appendString(p, "\"dt\":");
+        p = appendUInt(p, ticksPerValue);
+        *p++ = ',';
+    }
+    p = appendString(p, "\"ch\":[");
+    for (uint8_t c = 0; c < CHANNEL_COUNT; c++)
+    {
+        if (c)
+        {
+            *p++ = ',';
+        }
+        *p++ = '[';
+        for (size_t i = 0; i < count; i++)
+        {
+            if (i)
+            {
+                *p++ = ',';
+            }
+            p = appendUInt(p, frames[i].ch[c]);
+        }
+        *p++ = ']';
+    }
+    return appendString(p, "]}");
+}
+
+/**
+ * @brief Writes a StreamFrameHeader.
+ * 
+ * @return The write position just past the header.
+ */
+static uint8_t *writeHeader(uint8_t *out, size_t count, uint32_t seq, uint16_t sampleRate, uint8_t flags, uint8_t encoding, uint32_t genUs, uint32_t sentUs)
+{
+    StreamFrameHeader header;
+    header.version = STREAM_FRAME_VERSION;
+    header.flags = flags;
+    header.sampleRate = sampleRate;
+    header.seq = seq;
+    header.count = count;
+    header.channels = CHANNEL_COUNT;
+    header.encoding = encoding;
+    header.genUs = genUs;
+    header.sentUs = sentUs;
+    memcpy(out, &header, sizeof(header));
+    return out + sizeof(header);
+}
+
+/**
+ * @brief Appends an unsigned LEB128 varint: seven bits per byte, low bits first, top bit set on all but the last.
+ * 
+ * @param p Write position.
+ * @param val Value to append.
+ * @return The new write position.
+ */
+static uint8_t *appendVarint(uint8_t *p, uint32_t val)
+{
+    while (val >= 0x80)
+    {
+        *p++ = val | 0x80;
+        val >>= 7;
+    }
+    *p++ = val;
+    return p;
+}
+
+/**
+ * @brief Builds one binary /ws frame: a StreamFrameHeader followed by the frames as they are.
+ * 
+ * @param out Destination with room for sizeof(StreamFrameHeader) + count * sizeof(SampleFrame) bytes.
+ * @param frames Frames to send, oldest first.
+ * @param count Number of frames.
+ * @param seq Sequence number of the first frame.
+ * @param sampleRate Current sample rate in samples per second.
+ * @param flags STREAM_FLAG_* bits describing the current mode.
+ * @param genUs Generation time of the first frame.
+ * @param sentUs Time the frame is handed to the socket.
+ * @return Number of bytes written.
+ */
+size_t writeStreamFrame(uint8_t *out, const SampleFrame *frames, size_t count, uint32_t seq, uint16_t sampleRate, uint8_t flags, uint32_t genUs, uint32_t sentUs)
+{
+    uint8_t *p = writeHeader(out, count, seq, sampleRate, flags, STREAM_ENCODING_RAW, genUs, sentUs);
+    memcpy(p, frames, count * sizeof(SampleFrame));
+    return sizeof(StreamFrameHeader) + count * sizeof(SampleFrame);
+}
+
+/**
+ * @brief Builds one binary /ws frame with STREAM_ENCODING_DELTA samples.
+ * 
+ * Neighbouring samples rarely differ by more than a few counts, so most zigzag deltas fit one byte,
+ * and a flatline collapses into a zero and a run length. A difference never needs more than two
+ * bytes, and a zero and its run length always stand for at least one sample, so the payload stays
+ * within STREAM_DELTA_PAYLOAD_MAX. Every frame decodes on its own.
+ * 
+ * @param out Destination with room for sizeof(StreamFrameHeader) + STREAM_DELTA_PAYLOAD_MAX(count) bytes.
+ * @param frames Frames to send, oldest first.
+ * @param count Number of frames.
+ * @param seq Sequence number of the first frame.
+ * @param sampleRate Current sample rate in samples per second.
+ * @param flags STREAM_FLAG_* bits describing the current mode.
+ * @param genUs Generation time of the first frame.
+ * @param sentUs Time the frame is handed to the socket.
+ * @return Number of bytes written.
+ */
+size_t writeStreamFrameDelta(uint8_t *out, const SampleFrame *frames, size_t count, uint32_t seq, uint16_t sampleRate, uint8_t flags, uint32_t genUs, uint32_t sentUs)
+{
+    uint8_t *p = writeHeader(out, count, seq, sampleRate, flags, STREAM_ENCODING_DELTA, genUs, sentUs);
+    for (uint8_t c = 0; c < CHANNEL_COUNT; c++)
+    {
+        int32_t previous = 0;
+        size_t i = 0;
+        while (i < count)
+        {
+            const int32_t delta = frames[i].ch[c] - previous;
+            previous = frames[i++].ch[c];
+            p = appendVarint(p, (uint32_t)(delta << 1) ^ (uint32_t)(delta >> 31)); // Zigzag: 0, -1, 1, -2, ... to 0, 1, 2, 3, ...
+            if (delta == 0)
+            {
+                const size_t runStart = i;
+                while (i < count && frames[i].ch[c] == previous)
+                {
+                    i++;
+                }
+                p = appendVarint(p, i - runStart);
+            }
+        }
+    }
+    return p - out;
+}
@@ -0,0 +1,99 @@
+/**
+ * @file StreamFormat.h
+ * @brief Wire formats of the sample stream: SSE event records and binary /ws frames.
+ *
+ * Only formatting lives here, with no server or socket types, so the same code can be built and
+ * benchmarked on the host (see bench/native).
+ */
+
+#ifndef StreamFormat_h
+#define StreamFormat_h
+
+#include <Arduino.h>
+#include "SampleFrame.h"
+
+#ifndef NOTIFY_BATCH_MAX
+#define NOTIFY_BATCH_MAX 32 ///< Maximum number of frames packed into one "values" event.
+#endif
+
+/// Worst-case size of one formatted "values" event record: id/event lines, JSON punctuation and
+/// up to three digits plus a comma per value.
+#define SSE_RECORD_MAX (64 + CHANNEL_COUNT * (NOTIFY_BATCH_MAX * 4 + 3))
+
+#define STREAM_FRAME_VERSION 3 ///< Layout version of StreamFrameHeader, bumped on incompatible changes.
+#define STREAM_FLAG_EKG 0x01   ///< Set when the frame carries EKG samples, clear for ARY.
+#define STREAM_FLAG_ALIVE 0x02 ///< Set while the simulated patient is alive.
+#define STREAM_FLAG_REPLAY 0x04 ///< Set on a catch-up frame sent from the history instead of the live stream.
+
+#define STREAM_ENCODING_RAW 0   ///< StreamFrameHeader::encoding: SampleFrames as they are.
+#define STREAM_ENCODING_DELTA 1 ///< StreamFrameHeader::encoding: per-channel zigzag varint deltas with zero runs.
+
+/// Worst-case size of a STREAM_ENCODING_DELTA payload: no more than two bytes per sample.
+#define STREAM_DELTA_PAYLOAD_MAX(count) ((count) * CHANNEL_COUNT * 2)
+
+#define STREAM_RESUME_TYPE 2 ///< StreamResume::type.
+#define STREAM_RESUME_HAS_SEQ 0x01 ///< StreamResume::flags bit, set when nextSeq is valid.
+#define STREAM_CONTROL_TYPE 3 ///< StreamControl::type.
+
+/**
+ * @brief Header prepended to every binary frame sent over the /ws stream.
+ * 
+ * All fields are little-endian. With STREAM_ENCODING_RAW, count SampleFrames of channels bytes each follow
+ * the header directly, interleaved by tick. With STREAM_ENCODING_DELTA, each channel follows in turn as
+ * count samples: every sample is the zigzag varint of its difference from the previous one (from 0 for
+ * the first), and a zero difference is followed by a varint count of further repeats of the same value.
+ */
+struct __attribute__((packed)) StreamFrameHeader
+{
+    uint8_t version;     ///< STREAM_FRAME_VERSION.
+    uint8_t flags;       ///< STREAM_FLAG_* bits.
+    uint16_t sampleRate; ///< Samples per second at the time the frame was built.
+    uint32_t seq;        ///< Sequence number of the first sample in the frame.
+    uint16_t count;      ///< Number of SampleFrames following the header.
+    uint8_t channels;    ///< Number of channels in each SampleFrame.
+    uint8_t encoding;    ///< STREAM_ENCODING_* of the samples; 0 on frames from before it was defined.
+    uint32_t genUs;      ///< Device time the first sample was generated, in microseconds.
+    uint32_t sentUs;     ///< Device time the frame was handed to the socket, in microseconds.
+};
+
+/**
+ * @brief Message a /ws client sends after connecting to ask for the frames it missed.
+ *
+ * All fields are little-endian. A client without a previous stream leaves STREAM_RESUME_HAS_SEQ clear
+ * and gets the latest screen's worth instead. It also picks the encoding of the live frames it is sent;
+ * catch-up frames are always STREAM_ENCODING_RAW.
+ */
+struct __attribute__((packed)) StreamResume
+{
+    uint8_t type;        ///< STREAM_RESUME_TYPE.
+    uint8_t flags;       ///< STREAM_RESUME_* bits.
+    uint8_t encoding;    ///< STREAM_ENCODING_* the client can decode; 0 from pages that predate it.
+    uint8_t reserved;    ///< Always 0.
+    uint32_t nextSeq;    ///< Sequence number of the first frame the client does not have.
+};
+
+/**
+ * @brief Message a /ws client sends to change the generator's parameters, the binary form of POST /api/control.
+ *
+ * Fields mean the same as in ControlSet (RemoteControl.h).
+ */
+struct __attribute__((packed)) StreamControl
+{
+    uint8_t type;        ///< STREAM_CONTROL_TYPE.
+    uint8_t set;         ///< CONTROL_SET_* bits.
+    uint8_t state;       ///< CONTROL_EKG and CONTROL_ALIVE values.
+    uint8_t bpm;         ///< Heart rate, or 0 to hand it back to the knob.
+    uint8_t amp;         ///< ECG amplification in percent, or 0 to hand it back to the knob.
+    uint8_t rhythm;      ///< WavePack table index plus 1, or 0 for the built-in EKG or ARY.
+    uint8_t reserved[2]; ///< Always 0.
+};
+
+char *appendString(char *p, const char *str); ///< Copies a string into an event record.
+char *appendUInt(char *p, uint32_t val); ///< Formats an unsigned integer in decimal into an event record.
+char *beginRecord(char *p, const char *event, uint32_t id); ///< Writes the id/event lines and opens the data line.
+char *endRecord(char *p); ///< Terminates an event record.
+char *appendValues(char *p, const SampleFrame *frames, size_t count, uint8_t ticksPerValue); ///< Formats a "values" payload.
+size_t writeStreamFrame(uint8_t *out, const SampleFrame *frames, size_t count, uint32_t seq, uint16_t sampleRate, uint8_t flags, uint32_t genUs, uint32_t sentUs); ///< Builds a binary /ws frame.
+size_t writeStreamFrameDelta(uint8_t *out, const SampleFrame *frames, size_t count, uint32_t seq, uint16_t sampleRate, uint8_t flags, uint32_t genUs, uint32_t sentUs); ///< Builds a delta-encoded binary /ws frame.
+
+#endif
@@ -0,0 +1,84 @@
+/**
+ * @file WavePack.cpp
+ * @brief Implementation of the memory-mapped waveform pack.
+ */
+
+#include "WavePack.h"
+
+WavePack wavePack;
+
+/**
+ * @brief Finds the wavepack partition, maps it and indexes every table that lies within the pack.
+ *
+ * The mapping is kept for the lifetime of the firmware. A pack that fails the checks is ignored
+ * as a whole, so a half-written partition cannot hand the synthesiser a pointer past its end.
+ *
+ * @return true if a pack with at least one table was found.
+ */
+bool WavePack::begin()
+{
+    const esp_partition_t *partition = esp_partition_find_first(ESP_PARTITION_TYPE_DATA, (esp_partition_subtype_t)WAVEPACK_PARTITION_SUBTYPE, WAVEPACK_PARTITION_LABEL);
+    if (partition == nullptr)
+    {
+        Serial.println("No wavepack partition, using the built-in waveforms");
+        return false;
+    }
+
+    const void *mapped = nullptr;
+    spi_flash_mmap_handle_t handle;
+    if (esp_partition_mmap(partition, 0, partition->size, SPI_FLASH_MMAP_DATA, &mapped, &handle) != ESP_OK)
+    {
+        Serial.println("Failed to map the wavepack partition");
+        return false;
+    }
+
+    const uint8_t *base = (const uint8_t *)mapped;
+    WavePackHeader header;
+    memcpy(&header, base, sizeof(header));
+    const size_t indexEnd = sizeof(header) + (size_t)header.count * sizeof(WavePackEntry);
+    if (header.magic != WAVEPACK_MAGIC || header.version != WAVEPACK_VERSION || header.size > partition->size || indexEnd > header.size)
+    {
+        Serial.println("No valid waveform pack in the wavepack partition");
+        spi_flash_munmap(handle);
+        return false;
+    }
+
+    const WavePackEntry *entries = (const WavePackEntry *)(base + sizeof(header));
+    const size_t count = header.count < WAVEPACK_MAX_TABLES ? header.count : WAVEPACK_MAX_TABLES;
+    for (size_t i = 0; i < count; i++)
+    {
+        const WavePackEntry &entry = entries[i];
+        const uint8_t bits = entry.pointBits;
+        if (bits < WAVETABLE_MIN_POINT_BITS || bits > WAVETABLE_MAX_POINT_BITS || entry.offset < indexEnd || entry.offset > header.size ||
+            header.size - entry.offset < (1UL << bits) || memchr(entry.name, '\0', WAVEPACK_NAME_MAX) == nullptr)
+        {
+            Serial.printf("Waveform pack entry %u is damaged, ignoring the pack\r\n", (unsigned)i);
+            spi_flash_munmap(handle);
+            return false;
+        }
+        _tables[i].points = base + entry.offset;
+        _tables[i].pointBits = bits;
+    }
+    _entries = entries;
+    _count = count;
+    Serial.printf("Waveform pack: %u tables mapped from flash\r\n", (unsigned)_count);
+    return _count > 0;
+}
+
+/**
+ * @brief Looks a table up by name.
+ *
+ * @param name Name as given to scripts/build_wavepack.py, without the extension.
+ * @return Its index, or -1 if the pack has no such table.
+ */
+int WavePack::find(const char *name) const
+{
+    for (size_t i = 0; i < _count; i++)
+    {
+        if (strncmp(_entries[i].name, name, WAVEPACK_NAME_MAX) == 0)
+        {
+            return i;
+        }
+    }
+    return -1;
+}
@@ -0,0 +1,80 @@
+/**
+ * @file WavePack.h
+ * @brief Waveform library read in place from a dedicated flash partition.
+ *
+ * A pack is built from waves/ by scripts/build_wavepack.py and written to the "wavepack" data
+ * partition (see partitions.csv). begin() maps the partition into the data address space with
+ * esp_partition_mmap and checks it, after which every template is a WaveTable pointing straight into
+ * flash: the points are fetched through the flash cache as the synthesiser reads them and never take
+ * DRAM, and switching rhythm is swapping one pointer. Only the index, WAVEPACK_MAX_TABLES small
+ * entries, lives in RAM.
+ *
+ * Layout, little-endian: a WavePackHeader, count WavePackEntry records, then the points of every
+ * table. Without a valid pack the firmware just runs on its built-in templates.
+ */
+
+#ifndef WavePack_h
+#define WavePack_h
+
+#include <Arduino.h>
+#include <esp_partition.h>
+#include "WaveformSynth.h"
+
+#define WAVEPACK_PARTITION_LABEL "wavepack" ///< Name of the partition in partitions.csv.
+#define WAVEPACK_PARTITION_SUBTYPE 0x40 ///< Data subtype of the partition, in the user range.
+#define WAVEPACK_MAGIC 0x4B505657 ///< "WVPK".
+#define WAVEPACK_VERSION 1 ///< Layout version, bumped on incompatible changes.
+#define WAVEPACK_NAME_MAX 12 ///< Bytes of a table name, including the terminator.
+
+#ifndef WAVEPACK_MAX_TABLES
+#define WAVEPACK_MAX_TABLES 64 ///< Tables indexed from one pack; any further ones are ignored.
+#endif
+
+static_assert(WAVEPACK_MAX_TABLES <= 255, "rhythms are numbered in a byte");
+
+/**
+ * @brief Start of a waveform pack.
+ */
+struct __attribute__((packed)) WavePackHeader
+{
+    uint32_t magic;   ///< WAVEPACK_MAGIC.
+    uint16_t version; ///< WAVEPACK_VERSION.
+    uint16_t count;   ///< Number of WavePackEntry records that follow.
+    uint32_t size;    ///< Bytes in the whole pack, header included.
+};
+
+/**
+ * @brief One template of a waveform pack.
+ */
+struct __attribute__((packed)) WavePackEntry
+{
+    char name[WAVEPACK_NAME_MAX]; ///< NUL-terminated name, e.g. "vt".
+    uint32_t offset;              ///< Offset of the first point from the start of the pack.
+    uint8_t pointBits;            ///< log2 of the number of points.
+    uint8_t reserved[3];          ///< Always 0.
+};
+
+/**
+ * @class WavePack
+ * @brief Index of the templates in the memory-mapped wavepack partition.
+ */
+class WavePack
+{
+public:
+    WavePack() : _entries(nullptr), _count(0) {} ///< Constructor starts empty.
+
+    bool begin(); ///< Maps the partition and indexes its tables; call once from setup().
+    size_t count() const { return _count; } ///< Number of tables.
+    const WaveTable *table(size_t index) const { return index < _count ? &_tables[index] : nullptr; } ///< A table, nullptr past the end.
+    const char *name(size_t index) const { return index < _count ? _entries[index].name : nullptr; } ///< A table's name, nullptr past the end.
+    int find(const char *name) const; ///< Index of the table called @p name, or -1.
+
+private:
+    const WavePackEntry *_entries; ///< Entry records, in flash.
+    WaveTable _tables[WAVEPACK_MAX_TABLES]; ///< Pointers into flash, one per entry.
+    uint8_t _count; ///< Valid entries in _tables.
+};
+
+extern WavePack wavePack;
+
+#endif
@@ -0,0 +1,180 @@
+/**
+ * @file WaveformSynth.cpp
+ * @brief Implementation of the phase-accumulator waveform synthesiser and its built-in templates.
+ */
+
+#include "WaveformSynth.h"
+
+// Simulated data arrays, one beat each
+static constexpr uint8_t EKG[WAVEFORM_POINTS] = {
+    // Simulated EKG data points
+    65, 65, 65, 65, 70, 76, 74, 70, 65, 63, 65, 65, 65, 65, 48, 230, 40, 65, 65, 65, 74, 90, 100, 102, 100, 95, 80, 70, 65, 65, 65, 65
+};
+static constexpr uint8_t ARY[WAVEFORM_POINTS] = {
+    // Simulated ARY data points
+    65, 70, 67, 61, 70, 72, 74, 76, 70, 68, 67, 65, 63, 55, 48, 10, 15, 65, 67, 70, 74, 80, 100, 102, 100, 95, 80, 70, 65, 65, 65, 65
+};
+static constexpr uint8_t deadPoints[WAVEFORM_POINTS] = {
+    // Simulated "flatline" data points
+    65, 65, 65, 65, 65, 65, 65, 65, 65, 65, 65, 65, 65, 65, 65, 65, 65, 65, 65, 65, 65, 65, 65, 65, 65, 65, 65, 65, 65, 65, 65, 65
+};
+static constexpr uint8_t PLETH[WAVEFORM_POINTS] = {
+    // Simulated SpO2 pulse, upstroke just after the R-wave
+    40, 40, 39, 38, 37, 36, 35, 34, 33, 33, 32, 32, 31, 31, 30, 30, 30, 45, 80, 120, 150, 160, 150, 130, 110, 100, 102, 104, 95, 80, 60, 48
+};
+static constexpr uint8_t RESP[WAVEFORM_POINTS] = {
+    // Simulated breath, inhale then exhale
+    40, 41, 45, 50, 58, 67, 77, 88, 100, 112, 123, 133, 142, 150, 155, 159, 160, 159, 155, 150, 142, 133, 123, 112, 100, 88, 77, 67, 58, 50, 45, 41
+};
+
+static const WaveTable waveformTables[WAVEFORM_COUNT] = {
+    { EKG, WAVEFORM_POINT_BITS }, { ARY, WAVEFORM_POINT_BITS }, { deadPoints, WAVEFORM_POINT_BITS }, { PLETH, WAVEFORM_POINT_BITS }, { RESP, WAVEFORM_POINT_BITS }
+};
+
+/**
+ * @brief The built-in template of a waveform; unknown values get the flatline.
+ */
+const WaveTable &waveTable(Waveform waveform)
+{
+    return waveformTables[waveform < WAVEFORM_COUNT ? waveform : WAVEFORM_DEAD];
+}
+
+/**
+ * @brief Linear interpolation between two points.
+ *
+ * @param p1 Point at t = 0.
+ * @param p2 Point at t = 1.
+ * @param t Q16 fraction between the points.
+ */
+static constexpr int32_t interpolateLinear(int32_t p1, int32_t p2, int32_t t)
+{
+    return p1 + (((p2 - p1) * t) >> 16);
+}
+
+/**
+ * @brief Catmull-Rom interpolation between p1 and p2, evaluated in Horner form.
+ *
+ * Intermediate products stay below 2^28 for 8-bit inputs and a Q16 fraction, so 32-bit math is enough.
+ *
+ * @param p0 Point before p1.
+ * @param p1 Point at t = 0.
+ * @param p2 Point at t = 1.
+ * @param p3 Point after p2.
+ * @param t Q16 fraction between p1 and p2.
+ */
+static constexpr int32_t interpolateCubic(int32_t p0, int32_t p1, int32_t p2, int32_t p3, int32_t t)
+{
+    return p1 + ((t * ((p2 - p0) + ((t * ((2 * p0 - 5 * p1 + 4 * p2 - p3) + ((t * (3 * (p1 - p2) + p3 - p0)) >> 16))) >> 16))) >> 17);
+}
+
+// Spot checks of the fixed-point helpers against hand-computed values
+static_assert(interpolateLinear(65, 230, 0x8000) == 147, "linear midpoint");
+static_assert(interpolateCubic(65, 65, 65, 65, 0x8000) == 65, "cubic on a flat segment");
+static_assert(interpolateCubic(0, 100, 200, 300, 0x8000) == 150, "cubic on a straight line");
+
+/**
+ * @brief Constructs a synthesiser for the given output rate, starting at 60 BPM and unity gain.
+ *
+ * @param sampleRate Output sample rate in samples per second.
+ * @param interpolation Interpolation between template points.
+ */
+WaveformSynth::WaveformSynth(uint16_t sampleRate, Interpolation interpolation)
+    : _sampleRate(sampleRate), _interpolation(interpolation), _phase(0), _phaseStep(0), _bpm(0), _gain(GAIN_UNITY)
+{
+    setBpm(60);
+}
+
+/**
+ * @brief Sets the heart rate by recomputing the phase advance per output sample.
+ *
+ * One beat is a full 2^32 turn of the phase, so the step is bpm * 2^32 / (60 * sampleRate).
+ *
+ * @param bpm Heart rate in beats per minute.
+ */
+void WaveformSynth::setBpm(uint16_t bpm)
+{
+    if (bpm == _bpm.load(std::memory_order_relaxed))
+    {
+        return;
+    }
+    uint64_t step = ((uint64_t)bpm << 32) / (60UL * _sampleRate);
+    _phaseStep.store((uint32_t)step, std::memory_order_relaxed);
+    _bpm.store(bpm, std::memory_order_relaxed);
+}
+
+/**
+ * @brief Produces the next output sample and advances the phase.
+ *
+ * @param waveform The template to sample.
+ * @return The interpolated sample, scaled by the gain and clamped to the uint8_t range.
+ */
+uint8_t WaveformSynth::next(Waveform waveform)
+{
+    uint8_t value;
+    render(waveform, &value, 1);
+    return value;
+}
+
+/**
+ * @brief Counts the samples render() produces before the phase wraps into the next beat.
+ *
+ * Rendering exactly this many samples leaves the synthesiser on the first sample of a new beat, which is
+ * where a waveform can be swapped without a discontinuity. Call it from the task that renders.
+ *
+ * @return The sample count, at least 1, or UINT32_MAX while the phase is not advancing.
+ */
+uint32_t WaveformSynth::samplesToCycleEnd() const
+{
+    const uint32_t step = _phaseStep.load(std::memory_order_relaxed);
+    if (step == 0)
+    {
+        return UINT32_MAX;
+    }
+    const uint64_t remaining = (1ULL << 32) - _phase;
+    return (remaining + step - 1) / step;
+}
+
+/**
+ * @brief Produces a block of output samples, advancing the phase by one step per sample.
+ *
+ * The table, phase step and gain are loaded once for the whole block, and each sample is interpolated,
+ * multiplied by the Q8 gain and saturated in 32-bit integer math. Gains above GAIN_UNITY clip at 255
+ * instead of wrapping. The points are only read, so they can stay in memory-mapped flash.
+ *
+ * @param wave The template to sample.
+ * @param out Destination for the first sample.
+ * @param count Number of samples to produce.
+ * @param stride Distance between consecutive samples in @p out, e.g. CHANNEL_COUNT for interleaved frames.
+ */
+void WaveformSynth::render(const WaveTable &wave, uint8_t *out, size_t count, size_t stride)
+{
+    const uint8_t *table = wave.points;
+    const unsigned indexShift = 32 - wave.pointBits;
+    const unsigned fractionShift = indexShift - 16; // Phase bits below the Q16 fraction
+    const uint32_t pointMask = (1UL << wave.pointBits) - 1;
+    const uint32_t step = _phaseStep.load(std::memory_order_relaxed);
+    const int32_t gain = _gain.load(std::memory_order_relaxed);
+    uint32_t phase = _phase;
+
+    for (size_t n = 0; n < count; n++, out += stride)
+    {
+        const uint32_t index = phase >> indexShift;
+        const int32_t t = (phase >> fractionShift) & 0xFFFF;
+
+        int32_t value;
+        if (_interpolation == INTERP_CUBIC)
+        {
+            value = interpolateCubic(table[(index - 1) & pointMask], table[index], table[(index + 1) & pointMask], table[(index + 2) & pointMask], t);
+        }
+        else
+        {
+            value = interpolateLinear(table[index], table[(index + 1) & pointMask], t);
+        }
+        value = (value * gain) >> 8;
+
+        *out = constrain(value, 0, 255);
+        phase += step;
+    }
+
+    _phase = phase;
+}
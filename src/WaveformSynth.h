@@ -0,0 +1,93 @@
+/**
+ * @file WaveformSynth.h
+ * @brief Phase-accumulator waveform synthesis at a fixed output sample rate.
+ */
+
+#ifndef WaveformSynth_h
+#define WaveformSynth_h
+
+#include <Arduino.h>
+#include <atomic>
+
+#ifndef SYNTH_SAMPLE_RATE
+#define SYNTH_SAMPLE_RATE 250 ///< Output sample rate in samples per second.
+#endif
+
+#define WAVEFORM_POINT_BITS 5 ///< log2 of the number of points in one built-in waveform template.
+#define WAVEFORM_POINTS (1 << WAVEFORM_POINT_BITS) ///< Number of points in one built-in waveform template (one beat).
+#define WAVETABLE_MIN_POINT_BITS 2 ///< Smallest template resolution; cubic interpolation needs four points.
+#define WAVETABLE_MAX_POINT_BITS 16 ///< Largest template resolution, so the point index and the Q16 fraction both fit the phase.
+#define GAIN_UNITY 256 ///< Q8 gain of 1.0.
+
+/**
+ * @brief Waveform templates built into the firmware.
+ */
+enum Waveform : uint8_t
+{
+    WAVEFORM_EKG,   ///< Normal sinus rhythm.
+    WAVEFORM_ARY,   ///< Arrhythmia.
+    WAVEFORM_DEAD,  ///< Flatline.
+    WAVEFORM_PLETH, ///< SpO2 plethysmograph pulse.
+    WAVEFORM_RESP,  ///< One breath.
+    WAVEFORM_COUNT
+};
+
+/**
+ * @brief One beat of a waveform: 2^pointBits points, in RAM, in flash or in a memory-mapped WavePack.
+ */
+struct WaveTable
+{
+    const uint8_t *points; ///< First point.
+    uint8_t pointBits;     ///< log2 of the number of points, WAVETABLE_MIN_POINT_BITS to WAVETABLE_MAX_POINT_BITS.
+};
+
+const WaveTable &waveTable(Waveform waveform); ///< The built-in template of @p waveform.
+
+/**
+ * @brief Interpolation used between template points.
+ */
+enum Interpolation : uint8_t
+{
+    INTERP_LINEAR, ///< Straight lines between points, cheapest.
+    INTERP_CUBIC   ///< Catmull-Rom spline through the points, smooth QRS and T waves.
+};
+
+/**
+ * @class WaveformSynth
+ * @brief Resamples one-beat waveform templates onto a fixed output rate.
+ *
+ * A 32-bit phase accumulator covers exactly one beat, so any BPM maps onto the output rate without
+ * rounding the beat length to whole samples. The top pointBits of the phase select the template point
+ * and the following 16 bits are the Q16 fraction used for interpolation, so templates of any resolution
+ * play at the same rate. The output is scaled by a
+ * Q8 gain and saturated to the uint8_t range in the same integer pass. setBpm() and setGain() may be
+ * called from another task than next() and render().
+ */
+class WaveformSynth
+{
+public:
+    explicit WaveformSynth(uint16_t sampleRate = SYNTH_SAMPLE_RATE, Interpolation interpolation = INTERP_CUBIC);
+
+    void setBpm(uint16_t bpm); ///< Sets the heart rate; takes effect on the next sample.
+    void setGain(uint16_t gain) { _gain.store(gain, std::memory_order_relaxed); } ///< Sets the Q8 output gain, GAIN_UNITY = 1.0.
+    void setInterpolation(Interpolation interpolation) { _interpolation = interpolation; } ///< Selects linear or cubic interpolation.
+    uint8_t next(Waveform waveform); ///< Produces the next output sample of @p waveform.
+    void render(Waveform waveform, uint8_t *out, size_t count, size_t stride = 1) { render(waveTable(waveform), out, count, stride); } ///< Produces @p count samples of a built-in template.
+    void render(const WaveTable &table, uint8_t *out, size_t count, size_t stride = 1); ///< Produces @p count samples in one pass.
+
+    uint32_t samplesToCycleEnd() const; ///< Samples left in the current beat, counting the next one.
+
+    uint16_t sampleRate() const { return _sampleRate; } ///< Output sample rate in samples per second.
+    uint16_t bpm() const { return _bpm.load(std::memory_order_relaxed); } ///< Heart rate last set with setBpm().
+    uint16_t gain() const { return _gain.load(std::memory_order_relaxed); } ///< Q8 gain last set with setGain().
+
+private:
+    uint16_t _sampleRate; ///< Output sample rate in samples per second.
+    Interpolation _interpolation; ///< Interpolation between template points.
+    uint32_t _phase; ///< Position within the current beat, one full turn per beat.
+    std::atomic<uint32_t> _phaseStep; ///< Phase advance per output sample.
+    std::atomic<uint16_t> _bpm; ///< Heart rate the phase step was computed for.
+    std::atomic<uint16_t> _gain; ///< Q8 output gain.
+};
+
+#endif
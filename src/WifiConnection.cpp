@@ -0,0 +1,294 @@
+/**
+ * @file WifiConnection.cpp
+ * @brief Implementation of the WiFi connection state machine and the captive portal.
+ */
+
+#include "WifiConnection.h"
+#include "WiFiWebServer.h" // For the form parameter names
+#include "NetworkConfig.h"
+#include "SPIFFSManager.h"
+#include "MulticastStream.h"
+#include "WaveformSynth.h"
+#include <DNSServer.h>
+#include <ESPmDNS.h>
+#include <atomic>
+
+static DNSServer dnsServer;
+static WifiState state = WIFI_STATE_UNCONFIGURED; ///< Owned by loop().
+static unsigned long stateSince = 0; ///< When state last changed.
+static unsigned long lastRetry = 0; ///< When the station was last told to reconnect.
+static bool mdnsStarted = false; ///< Owned by loop().
+static std::atomic<bool> portalActive(false); ///< Read by the request filters on the async_tcp task.
+static std::atomic<bool> staHasIp(false); ///< Set from the WiFi event task.
+static std::atomic<bool> configChanged(false); ///< Set by the settings form on the async_tcp task.
+
+/**
+ * @brief WiFi event handler. Runs on the event task, so it only records what happened.
+ * 
+ * @param event The event.
+ * @param info Event details, unused.
+ */
+static void onWiFiEvent(WiFiEvent_t event, WiFiEventInfo_t info)
+{
+    switch (event)
+    {
+    case ARDUINO_EVENT_WIFI_STA_GOT_IP:
+        staHasIp = true;
+        break;
+    case ARDUINO_EVENT_WIFI_STA_DISCONNECTED:
+    case ARDUINO_EVENT_WIFI_STA_LOST_IP:
+        staHasIp = false;
+        break;
+    default:
+        break;
+    }
+}
+
+/**
+ * @brief Opens the setup SoftAP and the DNS server that points every name at it.
+ */
+static void startPortal()
+{
+    if (portalActive)
+    {
+        return;
+    }
+    WiFi.mode(state == WIFI_STATE_UNCONFIGURED ? WIFI_AP : WIFI_AP_STA);
+    WiFi.softAP(WIFI_AP_SSID, WIFI_AP_PASSWORD);
+    dnsServer.start(DNS_PORT, "*", WiFi.softAPIP());
+    portalActive = true;
+    Serial.print("Setup portal on " WIFI_AP_SSID " at ");
+    Serial.println(WiFi.softAPIP());
+}
+
+/**
+ * @brief Closes the setup SoftAP, leaving the station running.
+ */
+static void stopPortal()
+{
+    if (!portalActive)
+    {
+        return;
+    }
+    portalActive = false;
+    dnsServer.stop();
+    WiFi.softAPdisconnect(false);
+    WiFi.mode(WIFI_STA);
+}
+
+/**
+ * @brief Advertises the monitor over mDNS: the page at MDNS_HOSTNAME.local and, when it is on, the multicast stream.
+ *
+ * The stream's TXT record carries what a viewer needs to join it: group, frame version and sample rate.
+ * Started on the first connection; the responder follows later reconnects by itself.
+ */
+static void startMdns()
+{
+    if (mdnsStarted)
+    {
+        return;
+    }
+    if (!MDNS.begin(MDNS_HOSTNAME))
+    {
+        Serial.println("Failed to start mDNS");
+        return;
+    }
+    mdnsStarted = true;
+    MDNS.addService("http", "tcp", 80);
+    if (multicastStream.active())
+    {
+        MDNS.addService(MDNS_STREAM_SERVICE, "udp", multicastStream.port());
+        MDNS.addServiceTxt(MDNS_STREAM_SERVICE, "udp", "group", multicastStream.group().toString().c_str());
+        MDNS.addServiceTxt(MDNS_STREAM_SERVICE, "udp", "version", String(STREAM_FRAME_VERSION).c_str());
+        MDNS.addServiceTxt(MDNS_STREAM_SERVICE, "udp", "rate", String(SYNTH_SAMPLE_RATE).c_str());
+    }
+    Serial.println("mDNS name " MDNS_HOSTNAME ".local");
+}
+
+/**
+ * @brief Starts connecting the station with the settings in networkConfig.
+ * 
+ * Without an SSID the portal is opened instead. Without an IP address the station uses DHCP.
+ */
+static void beginStation()
+{
+    stateSince = millis();
+    lastRetry = stateSince;
+    if (networkConfig.ssid[0] == '\0')
+    {
+        Serial.println("Undefined SSID.");
+        state = WIFI_STATE_UNCONFIGURED;
+        startPortal();
+        return;
+    }
+
+    state = WIFI_STATE_CONNECTING;
+    WiFi.mode(portalActive ? WIFI_AP_STA : WIFI_STA);
+    WiFi.setAutoReconnect(true);
+
+    IPAddress localIP, localGateway, subnet(255, 255, 0, 0);
+    if (localIP.fromString(networkConfig.ip))
+    {
+        localGateway.fromString(networkConfig.gateway);
+        if (!WiFi.config(localIP, localGateway, subnet))
+        {
+            Serial.println("STA Failed to configure");
+        }
+    }
+    else
+    {
+        WiFi.config(IPAddress((uint32_t)0), IPAddress((uint32_t)0), IPAddress((uint32_t)0)); // Back to DHCP
+    }
+
+    WiFi.begin(networkConfig.ssid, networkConfig.pass);
+    Serial.println("Connecting to WiFi...");
+}
+
+/**
+ * @brief Initializes the WiFi connection from networkConfig.
+ * 
+ * Registers the event handler and starts the station, then returns straight away. serviceWiFi()
+ * takes it from there.
+ */
+void initWiFi()
+{
+    WiFi.onEvent(onWiFiEvent);
+    beginStation();
+}
+
+/**
+ * @brief Advances the connection state machine. Cheap enough to call on every loop() pass.
+ * 
+ * Answers portal DNS queries, applies settings saved from the portal, prints the address once the
+ * station is up, closes the portal and starts mDNS. It reopens the portal after WIFI_CONNECT_TIMEOUT_MS
+ * without a connection. A dropped connection is picked up again by the station's auto-reconnect,
+ * helped by a retry every WIFI_RETRY_INTERVAL_MS while the portal is open.
+ */
+void serviceWiFi()
+{
+    if (portalActive)
+    {
+        dnsServer.processNextRequest();
+    }
+    if (configChanged.exchange(false))
+    {
+        beginStation();
+    }
+
+    const unsigned long now = millis();
+    switch (state)
+    {
+    case WIFI_STATE_UNCONFIGURED:
+        break;
+
+    case WIFI_STATE_CONNECTING:
+        if (staHasIp)
+        {
+            state = WIFI_STATE_CONNECTED;
+            stateSince = now;
+            Serial.println("Connected!");
+            Serial.print("IP Address: ");
+            Serial.println(WiFi.localIP());
+            stopPortal();
+            startMdns();
+        }
+        else if (!portalActive && now - stateSince >= WIFI_CONNECT_TIMEOUT_MS)
+        {
+            Serial.println("Failed to connect.");
+            startPortal();
+        }
+        else if (portalActive && now - lastRetry >= WIFI_RETRY_INTERVAL_MS)
+        {
+            lastRetry = now;
+            WiFi.reconnect();
+        }
+        break;
+
+    case WIFI_STATE_CONNECTED:
+        if (!staHasIp)
+        {
+            state = WIFI_STATE_CONNECTING;
+            stateSince = now;
+            Serial.println("WiFi connection lost, reconnecting.");
+        }
+        break;
+    }
+}
+
+/**
+ * @brief Copies a posted form field into a settings field.
+ * 
+ * @param request The form submission.
+ * @param name Form field name.
+ * @param field Destination.
+ * @param size Size of @p field, including the terminator.
+ */
+static void copyParam(AsyncWebServerRequest *request, const char *name, char *field, size_t size)
+{
+    if (!request->hasParam(name, true))
+    {
+        return;
+    }
+    const String &value = request->getParam(name, true)->value();
+    strncpy(field, value.c_str(), size - 1);
+    field[size - 1] = '\0';
+}
+
+/**
+ * @brief Filter for requests that arrive over the setup SoftAP while it is up.
+ */
+static bool onPortal(AsyncWebServerRequest *request)
+{
+    return portalActive && ON_AP_FILTER(request);
+}
+
+/**
+ * @brief Adds the captive portal handlers.
+ * 
+ * While the portal is up, "/" on the SoftAP serves the settings form, posting it saves the
+ * settings and reconnects without a reboot, and any unknown URL redirects to the form so phones
+ * and laptops open it on their own.
+ * 
+ * @param server The web server.
+ */
+void addPortalRoutes(AsyncWebServer &server)
+{
+    server.on("/", HTTP_GET, [](AsyncWebServerRequest *request) {
+        request->send(SPIFFS, WIFI_PORTAL_PAGE, "text/html");
+    }).setFilter(onPortal);
+
+    server.on("/", HTTP_POST, [](AsyncWebServerRequest *request) {
+        copyParam(request, PARAM_INPUT_1, networkConfig.ssid, sizeof(networkConfig.ssid));
+        copyParam(request, PARAM_INPUT_2, networkConfig.pass, sizeof(networkConfig.pass));
+        copyParam(request, PARAM_INPUT_3, networkConfig.ip, sizeof(networkConfig.ip));
+        copyParam(request, PARAM_INPUT_4, networkConfig.gateway, sizeof(networkConfig.gateway));
+        saveNetworkConfig();
+        configChanged = true;
+        request->send(200, "text/plain", "Done. Connecting to " + String(networkConfig.ssid) + ", the monitor will be at " + String(networkConfig.ip[0] ? networkConfig.ip : "its DHCP address"));
+    }).setFilter(onPortal);
+
+    server.onNotFound([](AsyncWebServerRequest *request) {
+        if (onPortal(request))
+        {
+            request->redirect("http://" + WiFi.softAPIP().toString() + "/");
+            return;
+        }
+        request->send(404);
+    });
+}
+
+/**
+ * @brief Current station state.
+ */
+WifiState wifiState()
+{
+    return state;
+}
+
+/**
+ * @brief Whether the setup SoftAP is up.
+ */
+bool wifiPortalActive()
+{
+    return portalActive;
+}
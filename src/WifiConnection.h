@@ -0,0 +1,53 @@
+/**
+ * @file WifiConnection.h
+ * @brief Event-driven WiFi bring-up with a SoftAP captive portal fallback.
+ *
+ * initWiFi() only starts the station connection and returns, so the server and the generator
+ * run from the first second after boot. Progress is tracked from WiFi.onEvent and acted on in
+ * serviceWiFi(). If the station is not up within WIFI_CONNECT_TIMEOUT_MS, or there are no
+ * settings at all, a SoftAP comes up that serves wifimanager.html to every URL. The station
+ * keeps retrying in the background and the portal closes once it connects. The first connection
+ * also starts mDNS, which advertises the page and the multicast stream (see MulticastStream.h).
+ */
+
+#ifndef WifiConnection_h
+#define WifiConnection_h
+
+#include <WiFi.h>
+#include <ESPAsyncWebServer.h>
+
+#ifndef WIFI_CONNECT_TIMEOUT_MS
+#define WIFI_CONNECT_TIMEOUT_MS 10000 ///< Time the station gets before the portal is opened.
+#endif
+#ifndef WIFI_RETRY_INTERVAL_MS
+#define WIFI_RETRY_INTERVAL_MS 30000 ///< Interval between station retries while the portal is open.
+#endif
+#ifndef WIFI_AP_SSID
+#define WIFI_AP_SSID "ESP-WIFI-MANAGER" ///< Network name of the setup SoftAP.
+#endif
+#ifndef WIFI_AP_PASSWORD
+#define WIFI_AP_PASSWORD NULL ///< Passphrase of the setup SoftAP, NULL for an open network.
+#endif
+#ifndef MDNS_HOSTNAME
+#define MDNS_HOSTNAME "ekgsim" ///< mDNS name of the monitor once the station is up, MDNS_HOSTNAME.local.
+#endif
+#define WIFI_PORTAL_PAGE "/wifimanager.html" ///< Settings form served by the portal.
+#define DNS_PORT 53 ///< Port of the captive portal DNS server.
+
+/**
+ * @brief Station connection state.
+ */
+enum WifiState : uint8_t
+{
+    WIFI_STATE_UNCONFIGURED, ///< No SSID saved; only the portal is up.
+    WIFI_STATE_CONNECTING,   ///< Waiting for the station to get an address.
+    WIFI_STATE_CONNECTED     ///< Station has an address.
+};
+
+void initWiFi(); ///< Starts connecting with networkConfig; never blocks.
+void serviceWiFi(); ///< Advances the connection state machine; call from loop().
+void addPortalRoutes(AsyncWebServer &server); ///< Adds the portal handlers; call before any other "/" route.
+WifiState wifiState(); ///< Current station state.
+bool wifiPortalActive(); ///< Whether the setup SoftAP is up.
+
+#endif
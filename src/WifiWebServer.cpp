@@ -3,76 +3,334 @@
  * @brief Implementation file for the WiFi web server.
  * 
  * This file contains the implementation of the WiFi web server, which is responsible for handling
- * web requests and serving web pages. It includes functions for initializing the WiFi connection,
- * starting the server, and notifying connected clients with JSON data.
+ * web requests and serving web pages. It includes functions for starting the server and notifying
+ * connected clients with JSON data or binary frames. The WiFi connection itself lives in WifiConnection.cpp.
  */
 
 #include "WiFiWebServer.h"
 #include "SPIFFSManager.h" // For file operations
+#include "ClientFlow.h"
+#include "WifiConnection.h"
+#include "Metrics.h"
+#include "LatencyTrace.h"
+#include "SampleHistory.h"
+#include "ControlApi.h"
+#include "MulticastStream.h"
+#include "MemoryReport.h"
+#include "IdleMode.h"
+#include "WaveformSynth.h"
+#include <esp_timer.h>
+#include <atomic>
 
 // Initialize server on port 80
 AsyncWebServer server(80);
 AsyncEventSource events("/events");
+AsyncWebSocket ws("/ws");
 
 const char *PARAM_INPUT_1 = "ssid";
 const char *PARAM_INPUT_2 = "pass";
 const char *PARAM_INPUT_3 = "ip";
 const char *PARAM_INPUT_4 = "gateway";
 
+// Event records are formatted in place here so the streaming path never touches the heap
+static char sseRecord[SSE_RECORD_MAX];
+
+// Flow control and catch-up state for SSE clients; clients beyond the last slot always get the full-rate stream and no catch-up
+static ClientFlow clientFlows[DEFAULT_MAX_SSE_CLIENTS];
+
+static_assert(FLOW_PENDING_MAX <= NOTIFY_BATCH_MAX, "decimated records must fit in sseRecord");
+static_assert(ClientFlow::BUCKET_MAX <= NOTIFY_BATCH_MAX, "a flushed bucket must fit in sseRecord");
+
+// /ws catch-up frames are copied out of the history here; only used from the async_tcp task
+static SampleFrame replayFrames[HISTORY_REPLAY_MAX];
+
+// STREAM_FLAG_* bits of the last live frame, repeated on catch-up frames
+static volatile uint8_t streamFlags = STREAM_FLAG_EKG | STREAM_FLAG_ALIVE;
+
+// Delta-encoded live frames are built here before being copied into their message buffer; stream task only
+static uint8_t deltaFrame[sizeof(StreamFrameHeader) + STREAM_DELTA_PAYLOAD_MAX(NOTIFY_BATCH_MAX)];
+
+// Live /ws payload bytes queued per STREAM_ENCODING_*, counting every client that was sent them
+static std::atomic<uint32_t> wsBytesSent[STREAM_ENCODING_DELTA + 1];
+
+// Quoted ETag of the pages, empty when the filesystem was uploaded from data/ without the asset build
+static String pageEtag;
+
+/**
+ * @brief Terminates the event record in sseRecord.
+ * 
+ * @param p Write position just past the data payload.
+ * @return Length of the complete record in sseRecord.
+ */
+static size_t finishRecord(char *p)
+{
+    return endRecord(p) - sseRecord;
+}
+
 /**
- * @brief Initializes the WiFi connection with the provided parameters.
+ * @brief Finds the flow control slot of a client, claiming a free one for a new client.
  * 
- * This function configures the WiFi mode, IP address, and gateway based on the provided parameters.
- * It then attempts to connect to the WiFi network using the provided SSID and password.
- * If the connection is successful, it prints the local IP address.
+ * A new client's slot starts its catch-up: from its Last-Event-ID, or a screen's worth before @p seq.
+ * Slots are matched by id() as well, since a new client can be allocated where a freed one was.
  * 
- * @param ssid The SSID of the WiFi network.
- * @param password The password for the WiFi network.
- * @param ip The desired IP address for the device.
- * @param gateway The gateway IP address for the network.
+ * @param client The SSE client.
+ * @param seq Sequence number of the first frame of the batch being broadcast.
+ * @return The client's slot, or nullptr if every slot is taken.
  */
-void initWiFi(const String &ssid, const String &password, const String &ip, const String &gateway)
+static ClientFlow *flowFor(AsyncEventSourceClient *client, uint32_t seq)
 {
-    if (ssid.isEmpty() || ip.isEmpty())
+    ClientFlow *freeSlot = nullptr;
+    for (ClientFlow &flow : clientFlows)
     {
-        Serial.println("Undefined SSID or IP address.");
-        return;
+        if (flow.belongsTo(client, client->id()))
+        {
+            return &flow;
+        }
+        if (freeSlot == nullptr && flow.client() == nullptr)
+        {
+            freeSlot = &flow;
+        }
+    }
+    if (freeSlot)
+    {
+        freeSlot->reset(client, client->id());
+        freeSlot->beginCatchUp(client->lastId() ? client->lastId() : seq - HISTORY_REPLAY_MAX);
+    }
+    return freeSlot;
+}
+
+/**
+ * @brief Frees the flow control slots of clients the event source no longer lists.
+ */
+static void releaseStaleFlows()
+{
+    AsyncWebLockGuard guard(events.clientsLock()); // async_tcp adds and frees clients meanwhile
+    for (ClientFlow &flow : clientFlows)
+    {
+        if (flow.client() == nullptr)
+        {
+            continue;
+        }
+        bool listed = false;
+        for (AsyncEventSourceClient *client : events.clients())
+        {
+            if (flow.belongsTo(client, client->id()))
+            {
+                listed = true;
+                break;
+            }
+        }
+        if (!listed)
+        {
+            flow.reset(nullptr, 0);
+        }
     }
+}
 
-    WiFi.mode(WIFI_STA);
-    IPAddress localIP, localGateway, subnet(255, 255, 0, 0);
-    localIP.fromString(ip);
-    localGateway.fromString(gateway);
+/**
+ * @brief Sends a client's pending decimated frames as one "values" event.
+ * 
+ * @param client The SSE client.
+ * @param flow The client's flow control slot.
+ */
+static void flushFlow(AsyncEventSourceClient *client, ClientFlow &flow)
+{
+    if (flow.pendingCount() == 0)
+    {
+        return;
+    }
+    char *p = beginRecord(sseRecord, "values", flow.pendingSeq() + flow.pendingCount() * flow.ticksPerValue());
+    const bool queued = client->write(sseRecord, finishRecord(appendValues(p, flow.pending(), flow.pendingCount(), flow.ticksPerValue())));
+    flow.recordSend(flow.pendingCount() * flow.ticksPerValue(), queued);
+    flow.clearPending();
+}
 
-    if (!WiFi.config(localIP, localGateway, subnet))
+/**
+ * @brief Sends a client's partial min/max bucket as a full-rate "values" event, ahead of a level change.
+ * 
+ * @param client The SSE client.
+ * @param flow The client's flow control slot; flush its pending frames first.
+ */
+static void flushBucket(AsyncEventSourceClient *client, ClientFlow &flow)
+{
+    SampleFrame bucket[ClientFlow::BUCKET_MAX];
+    uint32_t seq;
+    const size_t count = flow.takeBucket(bucket, seq);
+    if (count == 0)
     {
-        Serial.println("STA Failed to configure");
         return;
     }
+    char *p = beginRecord(sseRecord, "values", seq + count);
+    flow.recordSend(count, client->write(sseRecord, finishRecord(appendValues(p, bucket, count, 1))));
+}
+
+/**
+ * @brief Sends a client that is still catching up the next chunks of what it missed, from the history.
+ * 
+ * A reconnecting browser sends Last-Event-ID, which is the sequence number it needs next; a new one
+ * sends none and gets the latest screen's worth. The catch-up goes out as ordinary "values" events of
+ * at most NOTIFY_BATCH_MAX frames, each a record that fits the TCP send buffer, and only while the
+ * client's queue is below FLOW_QUEUE_HIGH, so it never crowds out the queue; the rest follows with
+ * the next batches. Live frames are not sent meanwhile: the history has them too, so the catch-up
+ * carries on through them and ends with the batch that reaches the live stream.
+ * 
+ * @param client The SSE client.
+ * @param flow The client's flow control slot, or nullptr if it has none.
+ * @param end Sequence number just past the batch being broadcast, already in the history.
+ * @return true if the batch went out with the catch-up, or will, and must not be sent live.
+ */
+static bool serveCatchUp(AsyncEventSourceClient *client, ClientFlow *flow, uint32_t end)
+{
+    if (flow == nullptr || !flow->catchingUp())
+    {
+        return false;
+    }
+    SampleFrame chunk[NOTIFY_BATCH_MAX];
+    uint32_t next = flow->catchUpSeq();
+    while (next != end && client->packetsWaiting() < FLOW_QUEUE_HIGH)
+    {
+        uint32_t first;
+        const size_t count = sampleHistory.readFrom(next, chunk, NOTIFY_BATCH_MAX, first);
+        if (count == 0)
+        {
+            break;
+        }
+        char *p = beginRecord(sseRecord, "values", first + count);
+        const bool queued = client->write(sseRecord, finishRecord(appendValues(p, chunk, count, 1)));
+        flow->recordSend(count, queued);
+        if (!queued)
+        {
+            break; // Picked up again with the next batch
+        }
+        next = first + count;
+    }
+    flow->advanceCatchUp(next, next == end);
+    return true;
+}
+
+/**
+ * @brief The STREAM_ENCODING_* a /ws client asked for, kept in the client's _tempObject.
+ */
+static uint8_t socketEncoding(AsyncWebSocketClient *client)
+{
+    return (uint8_t)(uintptr_t)client->_tempObject;
+}
 
-    WiFi.begin(ssid.c_str(), password.c_str());
-    Serial.print("Connecting to WiFi...");
+/**
+ * @brief Sends a /ws client the frames it asked for in a StreamResume, as one binary frame.
+ * 
+ * The frame is sent even when it holds no frames, so the page knows the catch-up is over. The
+ * encoding the client asked for applies to the live frames from here on.
+ * 
+ * @param client The client that asked.
+ * @param data The message.
+ * @param len Message length; anything but a StreamResume is ignored.
+ */
+static void replayToSocketClient(AsyncWebSocketClient *client, const uint8_t *data, size_t len)
+{
+    StreamResume resume;
+    if (len != sizeof(resume))
+    {
+        return;
+    }
+    memcpy(&resume, data, sizeof(resume));
+    client->_tempObject = (void *)(uintptr_t)(resume.encoding == STREAM_ENCODING_DELTA ? STREAM_ENCODING_DELTA : STREAM_ENCODING_RAW);
 
-    unsigned long startAttemptTime = millis();
+    const uint32_t from = (resume.flags & STREAM_RESUME_HAS_SEQ) ? resume.nextSeq : sampleHistory.head() - HISTORY_REPLAY_MAX;
+    uint32_t first;
+    const size_t count = sampleHistory.read(from, replayFrames, HISTORY_REPLAY_MAX, first);
 
-    while (WiFi.status() != WL_CONNECTED && millis() - startAttemptTime < 10000)
+    AsyncWebSocketMessageBuffer *buffer = ws.makeBuffer(sizeof(StreamFrameHeader) + count * sizeof(SampleFrame));
+    if (buffer == nullptr || buffer->get() == nullptr)
     {
-        delay(100);
-        Serial.print(".");
+        return;
     }
+    const uint32_t now = (uint32_t)esp_timer_get_time();
+    writeStreamFrame(buffer->get(), replayFrames, count, first, SYNTH_SAMPLE_RATE, streamFlags | STREAM_FLAG_REPLAY, now, now);
+    client->binary(buffer);
+}
 
-    if (WiFi.status() != WL_CONNECTED)
+/**
+ * @brief Number of heap allocations the event source has made for queued messages since boot.
+ * 
+ * Formatting itself never allocates and queued messages come from the event source's pools,
+ * so this only moves when a pool runs out.
+ */
+uint32_t notifyAllocationCount()
+{
+    return AsyncEventSourceMessage::allocCount();
+}
+
+/**
+ * @brief Prints the per-client SSE counters in Prometheus text format.
+ * 
+ * @param out Destination.
+ */
+static void writeClientMetrics(Print &out)
+{
+    out.print("# HELP " METRICS_PREFIX "sse_client_samples_sent_total Frames queued for an SSE client, decimated ones included.\n"
+              "# TYPE " METRICS_PREFIX "sse_client_samples_sent_total counter\n");
+    for (size_t i = 0; i < DEFAULT_MAX_SSE_CLIENTS; i++)
     {
-        Serial.println("Failed to connect.");
+        if (clientFlows[i].client() != nullptr)
+        {
+            out.printf(METRICS_PREFIX "sse_client_samples_sent_total{slot=\"%u\"} %u\n", (unsigned)i, clientFlows[i].samplesSent());
+        }
     }
-    else
+    out.print("# HELP " METRICS_PREFIX "sse_client_samples_dropped_total Frames an SSE client's full queue refused.\n"
+              "# TYPE " METRICS_PREFIX "sse_client_samples_dropped_total counter\n");
+    for (size_t i = 0; i < DEFAULT_MAX_SSE_CLIENTS; i++)
     {
-        Serial.println("Connected!");
-        Serial.print("IP Address: ");
-        Serial.println(WiFi.localIP());
+        if (clientFlows[i].client() != nullptr)
+        {
+            out.printf(METRICS_PREFIX "sse_client_samples_dropped_total{slot=\"%u\"} %u\n", (unsigned)i, clientFlows[i].samplesDropped());
+        }
     }
+    out.print("# HELP " METRICS_PREFIX "sse_client_decimation_level Flow control level of an SSE client, 0 is full rate.\n"
+              "# TYPE " METRICS_PREFIX "sse_client_decimation_level gauge\n");
+    for (size_t i = 0; i < DEFAULT_MAX_SSE_CLIENTS; i++)
+    {
+        if (clientFlows[i].client() != nullptr)
+        {
+            out.printf(METRICS_PREFIX "sse_client_decimation_level{slot=\"%u\"} %u\n", (unsigned)i, clientFlows[i].level());
+        }
+    }
+    out.printf("# HELP " METRICS_PREFIX "sse_clients Connected SSE clients.\n# TYPE " METRICS_PREFIX "sse_clients gauge\n" METRICS_PREFIX "sse_clients %u\n", (unsigned)events.count());
+    out.printf("# HELP " METRICS_PREFIX "ws_clients Connected WebSocket clients.\n# TYPE " METRICS_PREFIX "ws_clients gauge\n" METRICS_PREFIX "ws_clients %u\n", (unsigned)ws.count());
+    out.printf("# HELP " METRICS_PREFIX "ws_bytes_sent_total Live frame bytes queued on WebSocket clients, by encoding.\n# TYPE " METRICS_PREFIX "ws_bytes_sent_total counter\n"
+               METRICS_PREFIX "ws_bytes_sent_total{encoding=\"raw\"} %u\n" METRICS_PREFIX "ws_bytes_sent_total{encoding=\"delta\"} %u\n",
+               wsBytesSent[STREAM_ENCODING_RAW].load(std::memory_order_relaxed), wsBytesSent[STREAM_ENCODING_DELTA].load(std::memory_order_relaxed));
 }
 
+/**
+ * @brief Sends an HTML page, answering revalidation requests with 304 Not Modified.
+ * 
+ * Pages keep their names across builds, so they are sent with "no-cache": the browser asks again on
+ * every load, and gets an empty 304 unless the asset build changed. The page itself only references
+ * hashed assets, which are cached for good.
+ * 
+ * @param request The request to answer.
+ * @param path Path of the page on the filesystem; the .gz variant is picked up automatically.
+ */
+static void sendPage(AsyncWebServerRequest *request, const char *path)
+{
+    if (pageEtag.length() && request->hasHeader("If-None-Match") && request->header("If-None-Match") == pageEtag)
+    {
+        AsyncWebServerResponse *response = request->beginResponse(304);
+        response->addHeader("Cache-Control", "no-cache");
+        response->addHeader("ETag", pageEtag);
+        request->send(response);
+        return;
+    }
+
+    AsyncWebServerResponse *response = request->beginResponse(SPIFFS, path, "text/html");
+    if (pageEtag.length())
+    {
+        response->addHeader("Cache-Control", "no-cache");
+        response->addHeader("ETag", pageEtag);
+    }
+    request->send(response);
+}
 
 /**
  * @brief Starts the web server and sets up the server routes and handlers.
@@ -82,14 +340,70 @@ void initWiFi(const String &ssid, const String &password, const String &ip, cons
  */
 void startServer()
 {
-    // Setup Server-Sent Events (SSE)
+    // Setup Server-Sent Events (SSE); joining clients wake an idle generator, then get what they missed
+    events.onConnect([](AsyncEventSourceClient *client) {
+        (void)client; // Its catch-up starts with the next batch, see serveCatchUp()
+        idleResume();
+    });
     server.addHandler(&events);
 
-    // Define your server routes and handlers here
+    // Setup the binary WebSocket stream
+    ws.onEvent([](AsyncWebSocket *server, AsyncWebSocketClient *client, AwsEventType type, void *arg, uint8_t *data, size_t len) {
+        if (type == WS_EVT_CONNECT)
+        {
+            idleResume();
+            server->cleanupClients();
+        }
+        else if (type == WS_EVT_DATA)
+        {
+            AwsFrameInfo *info = (AwsFrameInfo *)arg;
+            if (info->final && info->index == 0 && info->len == len && info->opcode == WS_BINARY && len > 0)
+            {
+                if (data[0] == STREAM_RESUME_TYPE)
+                {
+                    replayToSocketClient(client, data, len);
+                }
+                else if (data[0] == STREAM_CONTROL_TYPE)
+                {
+                    handleControlMessage(data, len);
+                }
+                else
+                {
+                    traceEcho(data, len);
+                }
+            }
+        }
+    });
+    server.addHandler(&ws);
+
+    // The asset build leaves its hash behind; without it the files are served as uploaded
+    String buildId = readFile(SPIFFS, WEB_BUILD_ID_FILE);
+    buildId.trim();
+    if (buildId.length())
+    {
+        pageEtag = "\"" + buildId + "\"";
+    }
+
+    // Define your server routes and handlers here; the portal's come first so they win while it is up
+    addPortalRoutes(server);
+    addControlRoutes(server);
+    addMemoryRoutes(server);
     server.on("/", HTTP_GET, [](AsyncWebServerRequest *request) {
-        request->send(SPIFFS, "/index.html", String(), false);
+        sendPage(request, "/index.html");
     });
 
+    server.on("/metrics", HTTP_GET, [](AsyncWebServerRequest *request) {
+        AsyncResponseStream *response = request->beginResponseStream("text/plain; version=0.0.4");
+        writeMetrics(*response);
+        writeClientMetrics(*response);
+        writeLatencyMetrics(*response);
+        multicastStream.writeMetrics(*response);
+        writeMemoryMetrics(*response);
+        writeIdleMetrics(*response);
+        request->send(response);
+    });
+
+    server.serveStatic(WEB_ASSET_PATH, SPIFFS, WEB_ASSET_PATH).setCacheControl(WEB_ASSET_CACHE_CONTROL);
     server.serveStatic("/", SPIFFS, "/");
 
     // Add more routes as needed
@@ -101,15 +415,178 @@ void startServer()
 /**
  * @brief Notifies all connected clients with a JSON object containing the given value.
  * 
+ * Clients still catching up get the sample with their catch-up instead, see serveCatchUp().
+ * 
  * @param val The value to be included in the JSON object.
+ * @param seq Sequence number of the sample; the event id is the one after it.
+ */
+void notifyClients(uint8_t val, uint32_t seq) {
+    AsyncWebLockGuard guard(events.clientsLock()); // Held through the fan-out, so no client is freed under it
+    releaseStaleFlows();
+    if (events.count() == 0)
+    {
+        return;
+    }
+    char *p = beginRecord(sseRecord, "value", seq + 1);
+    p = appendString(p, "{\"val\":");
+    p = appendUInt(p, val);
+    AsyncEventSourcePayload *shared = AsyncEventSourcePayload::create(sseRecord, finishRecord(appendString(p, "}")));
+    if (shared == nullptr)
+    {
+        return;
+    }
+
+    for (AsyncEventSourceClient *client : events.clients())
+    {
+        if (client->connected() && !serveCatchUp(client, flowFor(client, seq), seq + 1))
+        {
+            client->write(shared);
+        }
+    }
+    shared->release();
+}
+
+/**
+ * @brief Notifies all connected clients with a single "values" event holding a block of frames.
+ * 
+ * Packing several frames into one event amortises the SSE header and the TCP write over the
+ * whole block instead of paying them once per sample. The record is formatted directly into a
+ * static buffer sized for NOTIFY_BATCH_MAX frames, so nothing is allocated, and is shared by
+ * every client that keeps up.
+ * 
+ * A client whose queue backs up, or whose TCP send buffer has no room for the record, is moved
+ * to a decimated stream instead: min/max pairs that keep the QRS peaks, coalesced into fewer,
+ * larger events. It returns to the full-rate stream once its queue has stayed drained.
+ * 
+ * Every event's id is the sequence number just past its last frame: the previous event's id is where
+ * the next one must start, so a client can spot a gap, and a reconnecting browser's Last-Event-ID is
+ * exactly where its catch-up starts.
+ * 
+ * @param frames Pointer to the frames to send, oldest first.
+ * @param count Number of frames in @p frames; anything above NOTIFY_BATCH_MAX is ignored.
+ * @param seq Sequence number of the first frame.
+ */
+void notifyClientsBatch(const SampleFrame *frames, size_t count, uint32_t seq) {
+    AsyncWebLockGuard guard(events.clientsLock()); // Held through the fan-out, so no client is freed under it
+    releaseStaleFlows();
+    if (count == 0 || events.count() == 0)
+    {
+        return;
+    }
+    if (count > NOTIFY_BATCH_MAX)
+    {
+        count = NOTIFY_BATCH_MAX;
+    }
+
+    char *p = beginRecord(sseRecord, "values", seq + count);
+    const size_t len = finishRecord(appendValues(p, frames, count, 1));
+    AsyncEventSourcePayload *shared = AsyncEventSourcePayload::create(sseRecord, len);
+    if (shared == nullptr)
+    {
+        return;
+    }
+
+    for (AsyncEventSourceClient *client : events.clients())
+    {
+        if (!client->connected())
+        {
+            continue;
+        }
+        ClientFlow *flow = flowFor(client, seq);
+        if (serveCatchUp(client, flow, seq + count))
+        {
+            continue;
+        }
+        if (flow == nullptr)
+        {
+            client->write(shared);
+            continue;
+        }
+
+        const uint8_t level = flow->nextLevel(client->packetsWaiting(), client->client()->space(), len);
+        if (level != flow->level())
+        {
+            flushFlow(client, *flow); // Pending frames and the partial bucket were decimated at the old level
+            flushBucket(client, *flow);
+            flow->setLevel(level);
+        }
+        if (level == 0)
+        {
+            flow->recordSend(count, client->write(shared));
+        }
+        else if (flow->push(frames, count, seq))
+        {
+            flushFlow(client, *flow);
+        }
+    }
+    shared->release();
+}
+
+/**
+ * @brief Sends a block of frames as one binary message to every connected /ws client.
+ * 
+ * Each encoding a client asked for is built at most once, into a shared AsyncWebSocketMessageBuffer
+ * that is queued on its clients by reference, so the payload is not copied per client.
+ * 
+ * @param frames Pointer to the frames to send, oldest first.
+ * @param count Number of frames in @p frames; anything above NOTIFY_BATCH_MAX is ignored.
+ * @param seq Sequence number of the first frame.
+ * @param sampleRate Current sample rate in samples per second.
+ * @param flags STREAM_FLAG_* bits describing the current mode.
+ * @param genUs Generation time of the first frame, for latency tracing.
  */
-void notifyClients(uint8_t val) {
-    // Construct a simple JSON object to hold the data
-    JsonDocument doc;
-    doc["val"] = val; // Add the ECG value
-    // Convert the JSON object to a string
-    String output;
-    serializeJson(doc, output);
-    // Send the data to all connected clients
-    events.send(output.c_str(), "value", millis());
-}
\ No newline at end of file
+void streamFrame(const SampleFrame *frames, size_t count, uint32_t seq, uint16_t sampleRate, uint8_t flags, uint32_t genUs) {
+    streamFlags = flags;
+    if (count == 0 || ws.count() == 0)
+    {
+        return;
+    }
+    if (count > NOTIFY_BATCH_MAX)
+    {
+        count = NOTIFY_BATCH_MAX;
+    }
+
+    const uint32_t sentUs = (uint32_t)esp_timer_get_time();
+    AsyncWebSocketMessageBuffer *buffers[STREAM_ENCODING_DELTA + 1] = {};
+    AsyncWebLockGuard guard(ws.clientsLock()); // Also keeps _cleanBuffers() off the buffers until they are unlocked
+    for (AsyncWebSocketClient *client : ws.clients())
+    {
+        if (client->status() != WS_CONNECTED)
+        {
+            continue;
+        }
+        const uint8_t encoding = socketEncoding(client);
+        AsyncWebSocketMessageBuffer *&buffer = buffers[encoding];
+        if (buffer == nullptr)
+        {
+            if (encoding == STREAM_ENCODING_DELTA)
+            {
+                buffer = ws.makeBuffer(deltaFrame, writeStreamFrameDelta(deltaFrame, frames, count, seq, sampleRate, flags, genUs, sentUs));
+            }
+            else
+            {
+                buffer = ws.makeBuffer(sizeof(StreamFrameHeader) + count * sizeof(SampleFrame));
+                if (buffer != nullptr && buffer->get() != nullptr)
+                {
+                    writeStreamFrame(buffer->get(), frames, count, seq, sampleRate, flags, genUs, sentUs);
+                }
+            }
+            if (buffer == nullptr || buffer->get() == nullptr)
+            {
+                buffer = nullptr; // Out of memory; the next client of this encoding tries again
+                continue;
+            }
+            buffer->lock(); // Not freed while its first clients are still being queued
+        }
+        client->binary(buffer);
+        wsBytesSent[encoding].store(wsBytesSent[encoding].load(std::memory_order_relaxed) + buffer->length(), std::memory_order_relaxed);
+    }
+    for (AsyncWebSocketMessageBuffer *buffer : buffers)
+    {
+        if (buffer != nullptr)
+        {
+            buffer->unlock();
+        }
+    }
+    traceBatchSent(genUs, sentUs);
+}
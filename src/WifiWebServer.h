@@ -5,17 +5,25 @@
 #include <ESPAsyncWebServer.h>
 #include <AsyncTCP.h>
 #include <ArduinoJson.h>  // Include the ArduinoJson library for easy JSON manipulation
+#include "StreamFormat.h"
+
+#define WEB_ASSET_PATH "/a/" ///< Content-hashed assets written by scripts/build_web_assets.py.
+#define WEB_ASSET_CACHE_CONTROL "public, max-age=31536000, immutable" ///< Hashed names never change content.
+#define WEB_BUILD_ID_FILE "/webbuild.txt" ///< Hash of the built asset set, used as the ETag of the pages.
 
 extern AsyncWebServer server;
 extern AsyncEventSource events; // Declare an AsyncEventSource for SSE
+extern AsyncWebSocket ws; // Binary sample stream
 
 extern const char* PARAM_INPUT_1;
 extern const char* PARAM_INPUT_2;
 extern const char* PARAM_INPUT_3;
 extern const char* PARAM_INPUT_4;
 
-void initWiFi(const String& ssid, const String& password, const String& ip, const String& gateway);
 void startServer();
-void notifyClients(uint8_t val);  // Simplified to just send the uint8_t value
+void notifyClients(uint8_t val, uint32_t seq);  // Simplified to just send the uint8_t value
+void notifyClientsBatch(const SampleFrame *frames, size_t count, uint32_t seq);  // Sends up to NOTIFY_BATCH_MAX frames in one event
+uint32_t notifyAllocationCount();  // Heap allocations made for queued SSE messages since boot
+void streamFrame(const SampleFrame *frames, size_t count, uint32_t seq, uint16_t sampleRate, uint8_t flags, uint32_t genUs);  // Sends one binary frame to all /ws clients
 
 #endif
@@ -5,11 +5,54 @@
 
 #include <Arduino.h>
 #include "SPIFFSManager.h"
+#include "NetworkConfig.h"
 #include "WiFiWebServer.h"
-#include <ESP32TimerInterrupt.h>
-
-// Interval for ISR callback in milliseconds
-#define TIMER0_INTERVAL_MS 1
+#include "WifiConnection.h"
+#include "SpscRing.h"
+#include "WaveformSynth.h"
+#include "InputSampler.h"
+#include "Metrics.h"
+#include "SoakReport.h"
+#include "SampleHistory.h"
+#include "ButtonInput.h"
+#include "RemoteControl.h"
+#include "WavePack.h"
+#include "MulticastStream.h"
+#include "MemoryReport.h"
+#include "IdleMode.h"
+#include <esp_timer.h>
+#include <atomic>
+
+// Sample producer task configuration
+#define PRODUCER_TASK_PRIORITY (configMAX_PRIORITIES - 3) ///< Above async_tcp and loopTask so samples are never late.
+#define PRODUCER_TASK_STACK 2048 ///< Stack size in bytes for the producer task.
+#if CONFIG_ASYNC_TCP_RUNNING_CORE == 0
+#define PRODUCER_TASK_CORE 1
+#elif CONFIG_ASYNC_TCP_RUNNING_CORE == 1
+#define PRODUCER_TASK_CORE 0
+#else
+#define PRODUCER_TASK_CORE ARDUINO_RUNNING_CORE ///< async_tcp floats, so stay off the WiFi core.
+#endif
+
+// Stream task configuration: frames and encodes batches next to the producer, away from the network core
+#define STREAM_TASK_PRIORITY 2 ///< Above loopTask, below async_tcp so queuing data never starves the stack that sends it.
+#define STREAM_TASK_STACK 4096 ///< Stack size in bytes for the stream task.
+#define STREAM_TASK_CORE PRODUCER_TASK_CORE
+
+// Set to 0 to fall back to one "value" event per sample
+#ifndef NOTIFY_BATCHED
+#define NOTIFY_BATCHED 1
+#endif
+
+// Time the stream task waits between batches, so each event carries several samples at SYNTH_SAMPLE_RATE
+#ifndef NOTIFY_INTERVAL_MS
+#define NOTIFY_INTERVAL_MS 20
+#endif
+
+// Interval between allocation reports on the serial console, 0 leaves them out; /metrics always has the count
+#ifndef ALLOC_REPORT_INTERVAL_MS
+#define ALLOC_REPORT_INTERVAL_MS 0
+#endif
 
 // Pin definitions
 #define BPM_STICK_PIN GPIO_NUM_34 ///< BPM input pin.
@@ -18,164 +61,272 @@
 #define KLL_SWITCH_PIN GPIO_NUM_27 ///< Button pin to simulate patient's life status.
 
 
-// Simulated data arrays
-static uint8_t EKG[] = {
-    // Simulated EKG data points
-	65, 65, 65, 65, 70, 76, 74, 70, 65, 63, 65, 65, 65, 65, 48, 230, 40, 65, 65, 65, 74, 90, 100, 102, 100, 95, 80, 70, 65, 65, 65, 65
-};
-static uint8_t ARY[] = {
-	// Simulated ARY data points
-	65, 70, 67, 61, 70, 72, 74, 76, 70, 68, 67, 65, 63, 55, 48, 10, 15, 65, 67, 70, 74, 80, 100, 102, 100, 95, 80, 70, 65, 65, 65, 65
-};
-static uint8_t deadPoints[] = {
-	// Simulated "flatline" data points
-	65, 65, 65, 65, 65, 65, 65, 65, 65, 65, 65, 65, 65, 65, 65, 65, 65, 65, 65, 65, 65, 65, 65, 65, 65, 65, 65, 65, 65, 65, 65, 65
-};
+#define FIFO_CAPACITY 512 ///< Number of frames the FIFO can hold; must be a power of two.
+#define PRODUCER_BLOCK 8 ///< Frames rendered per synthesiser call when the producer has fallen behind.
+#define RESP_RATE 15 ///< Simulated respiration rate in breaths per minute.
+
+// Global state variables
+AnalogKnob bpmKnob(BPM_STICK_PIN, BPM_MIN, BPM_MAX); ///< Simulated heart rate in beats per minute.
+AnalogKnob ampKnob(AMP_STICK_PIN, AMP_MIN, AMP_MAX); ///< ECG amplification in percent; above 100 boosts and clips at full scale.
+uint32_t samplePeriodUs = 0; ///< Current interval between data points in microseconds, 0 until the timer is started.
+#if ALLOC_REPORT_INTERVAL_MS
+unsigned long lastAllocReportTime = 0; ///< Last time the SSE allocation count was printed.
+#endif
+
+std::atomic<bool> isAlive(true); ///< Indicates if the simulated patient is "alive"; written by the producer task only.
+std::atomic<bool> isEKG(true); ///< Indicates if the current mode is EKG or ARY; written by the producer task only.
+
+uint8_t ecgRhythm = 0; ///< WavePack table index plus 1 playing as the ECG, 0 for the built-in EKG or ARY; producer task only.
+const WaveTable *ecgRhythmTable = nullptr; ///< The table of ecgRhythm, nullptr for the built-ins; producer task only.
+
+DebouncedButton aryButton(ARY_SWITCH_PIN); ///< Toggles between EKG and ARY modes.
+DebouncedButton kllButton(KLL_SWITCH_PIN); ///< Toggles the patient's life status.
+
+std::atomic<uint32_t> sampleSeq(0); ///< Sequence number of the next sample handed to the transports; written by the stream task.
 
-const int maxSize = 512; ///< Maximum size for the FIFO buffer.
+SpscRing<StampedFrame, FIFO_CAPACITY> valueFifo; ///< FIFO between the producer task and the stream task (consumer).
+esp_timer_handle_t sampleTimer = nullptr; ///< Periodic timer that paces the producer task.
+TaskHandle_t producerTaskHandle = nullptr; ///< Task that generates the data points.
+TaskHandle_t streamTaskHandle = nullptr; ///< Task that encodes queued frames and hands them to the transports.
+WaveformSynth channelSynth[CHANNEL_COUNT]; ///< One synthesiser per channel, all at SYNTH_SAMPLE_RATE.
 
 /**
- * @class SimpleFIFO
- * @brief Implements a basic FIFO (First In First Out) buffer for data management.
+ * @brief Switches the ECG to a pack rhythm, or back to the built-ins; only the table pointer changes.
+ * 
+ * @param rhythm WavePack table index plus 1, or 0 for the built-in EKG or ARY; unknown ones mean 0.
  */
-class SimpleFIFO
+void setRhythm(uint8_t rhythm)
 {
-public:
-    SimpleFIFO() : frontIndex(0), rearIndex(0), itemCount(0) {}  ///< Constructor initializes FIFO indices and item count.
+    ecgRhythmTable = rhythm ? wavePack.table(rhythm - 1) : nullptr;
+    ecgRhythm = ecgRhythmTable ? rhythm : 0;
+}
 
-    bool enqueue(uint8_t data) ///< Adds a data point to the FIFO buffer.
+/**
+ * @brief Applies the mode changes made since the last beat; called on the first sample of a beat.
+ * 
+ * Remote changes set a mode, then button presses toggle it: an odd number of presses toggles the
+ * mode, an even number leaves it as it was. Choosing EKG or ARY leaves any pack rhythm.
+ */
+void applyPendingModes()
+{
+    uint8_t state;
+    uint8_t rhythm;
+    const uint8_t remote = remoteControl.takeModes(state, rhythm);
+    if (remote & CONTROL_SET_EKG)
     {
-        if (itemCount < maxSize)
-        {
-            buffer[rearIndex] = data;
-            rearIndex = (rearIndex + 1) % maxSize;
-            itemCount++;
-            return true;
-        }
-        return false; // Overflow, unable to enqueue
+        isEKG.store(state & CONTROL_EKG, std::memory_order_relaxed);
+        setRhythm(0);
     }
-
-    bool dequeue(uint8_t &data) ///< Removes the oldest data point from the FIFO buffer.
+    if (remote & CONTROL_SET_ALIVE)
     {
-        if (itemCount > 0)
-        {
-            data = buffer[frontIndex];
-            frontIndex = (frontIndex + 1) % maxSize;
-            itemCount--;
-            return true;
-        }
-        return false; // Underflow, unable to dequeue
+        isAlive.store(state & CONTROL_ALIVE, std::memory_order_relaxed);
     }
-
-    bool isEmpty() const ///< Checks if the FIFO buffer is empty.
+    if (remote & CONTROL_SET_RHYTHM)
     {
-        return itemCount == 0;
+        setRhythm(rhythm);
     }
+    if (aryButton.takePresses() & 1)
+    {
+        isEKG.store(!isEKG.load(std::memory_order_relaxed), std::memory_order_relaxed);
+        setRhythm(0);
+    }
+    if (kllButton.takePresses() & 1)
+    {
+        isAlive.store(!isAlive.load(std::memory_order_relaxed), std::memory_order_relaxed);
+    }
+}
 
-private:
-    uint8_t buffer[maxSize]; ///< Storage for the FIFO buffer.
-    int frontIndex; ///< Index of the oldest data point.
-    int rearIndex; ///< Index for the next data point insertion.
-    int itemCount; ///< Current number of items in the buffer.
-};
-
-// Global state variables
-float amp; ///< Amplification factor for signal visualization.
-long bpm; ///< Simulated heart rate in beats per minute.
-int delayMillis = 9; ///< Delay between data points to control simulation speed.
-
-bool isAlive = true; ///< Indicates if the simulated patient is "alive".
-bool isEKG = true; ///< Indicates if the current mode is EKG or ARY.
-
-// Button debouncing variables for ARY_SWITCH_PIN
-bool buttonState = false; ///< Current debounced state of the button.
-bool lastButtonState = LOW; ///< Previous read state of the button.
-unsigned long lastDebounceTime = 0; ///< Last time the button state changed.
+/**
+ * @brief Generates the next @p count data points of every channel and enqueues them as frames.
+ * 
+ * Each synthesiser renders its channel for a whole block straight into the interleaved frames,
+ * with the gain already applied. Every frame of a block carries the block's generation time.
+ * Blocks never cross an ECG beat boundary, so mode changes land between two beats instead of
+ * cutting one short.
+ * 
+ * @param count Number of frames to produce.
+ */
+void produceSamples(size_t count)
+{
+    SampleFrame block[PRODUCER_BLOCK];
+    while (count)
+    {
+        const uint32_t toCycleEnd = channelSynth[CHANNEL_ECG].samplesToCycleEnd();
+        size_t n = count < PRODUCER_BLOCK ? count : PRODUCER_BLOCK;
+        n = n < toCycleEnd ? n : toCycleEnd;
+        const uint32_t stampUs = (uint32_t)esp_timer_get_time();
 
-// Button debouncing variables for KLL_SWITCH_PIN
-bool buttonStateKLL = false; 
-bool lastButtonStateKLL = LOW; 
-unsigned long lastDebounceTimeKLL = 0; 
+        // Based on the simulated patient's status, render the appropriate data points
+        if (isAlive.load(std::memory_order_relaxed))
+        {
+            const WaveTable &ecg = ecgRhythmTable ? *ecgRhythmTable : waveTable(isEKG.load(std::memory_order_relaxed) ? WAVEFORM_EKG : WAVEFORM_ARY);
+            channelSynth[CHANNEL_ECG].render(ecg, &block[0].ch[CHANNEL_ECG], n, CHANNEL_COUNT);
+            channelSynth[CHANNEL_PLETH].render(WAVEFORM_PLETH, &block[0].ch[CHANNEL_PLETH], n, CHANNEL_COUNT);
+            channelSynth[CHANNEL_RESP].render(WAVEFORM_RESP, &block[0].ch[CHANNEL_RESP], n, CHANNEL_COUNT);
+        }
+        else
+        {
+            for (uint8_t c = 0; c < CHANNEL_COUNT; c++)
+            {
+                channelSynth[c].render(WAVEFORM_DEAD, &block[0].ch[c], n, CHANNEL_COUNT);
+            }
+        }
 
-unsigned long debounceDelay = 50; ///< Debounce delay in milliseconds.
+        for (size_t i = 0; i < n; i++)
+        {
+            valueFifo.enqueue(StampedFrame{ block[i], stampUs });
+        }
+        count -= n;
+        if (n == toCycleEnd)
+        {
+            applyPendingModes();
+        }
+    }
+}
 
-SimpleFIFO valueFifo; ///< FIFO buffer instance for EKG data management.
-ESP32Timer ITimer0(0); ///< Timer instance for periodic ISR callbacks.
+/**
+ * @brief Timer callback fired once per data point; wakes the producer task.
+ * 
+ * @param arg Unused.
+ */
+void onSampleTimer(void *arg)
+{
+    metricsTimerTick(samplePeriodUs);
+    xTaskNotifyGive(producerTaskHandle);
+}
 
 /**
- * @brief Timer interrupt service routine for generating EKG data points.
+ * @brief Producer task body. Sleeps until the sample timer fires, then generates every data point that is due.
  * 
- * @param timerNo Pointer to timer number (unused).
- * @return true to continue timer operation, false to stop.
+ * @param arg Unused.
  */
-bool IRAM_ATTR TimerHandler0(void *timerNo) 
+void sampleProducerTask(void *arg)
 {
-    static int xbyte = 0;
-    xbyte = (xbyte + 1) % delayMillis;
-    if (xbyte != 0)
+    for (;;)
     {
-        return true;
+        uint32_t due = ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+        remoteControl.advance(due); // Scenario steps due by now, before their samples are rendered
+        int32_t heartRate = bpmKnob.value();
+        int32_t amp = ampKnob.value();
+        remoteControl.parameters(heartRate, amp);
+        channelSynth[CHANNEL_ECG].setBpm(heartRate);
+        channelSynth[CHANNEL_PLETH].setBpm(heartRate);
+        const int64_t start = esp_timer_get_time();
+        channelSynth[CHANNEL_ECG].setGain((amp * GAIN_UNITY) / 100);
+        produceSamples(due);
+        remoteControl.publish(heartRate, amp, (isEKG.load(std::memory_order_relaxed) ? CONTROL_EKG : 0) | (isAlive.load(std::memory_order_relaxed) ? CONTROL_ALIVE : 0), ecgRhythm);
+        if (valueFifo.size() >= NOTIFY_BATCH_MAX)
+        {
+            xTaskNotifyGive(streamTaskHandle); // A full batch is waiting, no need to sit out the interval
+        }
+        metricsStageTime(STAGE_GENERATE, esp_timer_get_time() - start);
     }
+}
 
-    static int index = 0;
-    index = (index + 1) % sizeof(EKG);
+/**
+ * @brief Hands the next batch of queued frames to the transports.
+ * 
+ * Each batch is encoded once per transport and the result shared by every client.
+ * 
+ * @return true if a full batch was sent, so more frames may be waiting.
+ */
+bool streamPendingFrames()
+{
+	uint32_t seq = sampleSeq.load(std::memory_order_relaxed);
+#if NOTIFY_BATCHED
+	StampedFrame stamped[NOTIFY_BATCH_MAX];
+	SampleFrame batch[NOTIFY_BATCH_MAX];
+	const size_t batchCount = valueFifo.isEmpty() ? 0 : valueFifo.dequeue(stamped, NOTIFY_BATCH_MAX);
+	if (batchCount == 0)
+	{
+		return false;
+	}
+	for (size_t i = 0; i < batchCount; i++)
+	{
+		batch[i] = stamped[i].frame;
+	}
+	uint8_t flags = (isEKG.load(std::memory_order_relaxed) ? STREAM_FLAG_EKG : 0) | (isAlive.load(std::memory_order_relaxed) ? STREAM_FLAG_ALIVE : 0);
+	const uint32_t notifyStart = micros();
+	sampleHistory.append(batch, batchCount); // Before the broadcast, so a client catching up can take this batch from the history too
+	notifyClientsBatch(batch, batchCount, seq);
+	streamFrame(batch, batchCount, seq, SYNTH_SAMPLE_RATE, flags, stamped[0].stampUs);
+	multicastStream.send(batch, batchCount, seq, SYNTH_SAMPLE_RATE, flags, stamped[0].stampUs); // Returns at once unless MULTICAST_STREAM opened it
+	metricsNotifyLatency(micros() - notifyStart);
+	sampleSeq.store(seq + batchCount, std::memory_order_relaxed);
+	metricsSetFifo(valueFifo.size(), valueFifo.highWater(), valueFifo.overruns());
+	return batchCount == NOTIFY_BATCH_MAX;
+#else
+	StampedFrame stamped;
+	if (valueFifo.isEmpty() || !valueFifo.dequeue(stamped))
+	{
+		return false;
+	}
+	sampleHistory.append(&stamped.frame, 1);
+	notifyClients(stamped.frame.ch[CHANNEL_ECG], seq); // The single-value event only carries the ECG channel
+	sampleSeq.store(seq + 1, std::memory_order_relaxed);
+	return true;
+#endif
+}
 
-    // Based on the simulated patient's status, enqueue the appropriate data points
-    if (isAlive)
+/**
+ * @brief Stream task body. Wakes every NOTIFY_INTERVAL_MS, or early when the producer has a full batch, and sends what is queued.
+ * 
+ * While idle it sleeps until setStreaming() wakes it.
+ * 
+ * @param arg Unused.
+ */
+void streamTask(void *arg)
+{
+    for (;;)
     {
-        if (isEKG)
+        ulTaskNotifyTake(pdTRUE, idleActive() ? portMAX_DELAY : pdMS_TO_TICKS(NOTIFY_INTERVAL_MS));
+        const int64_t start = esp_timer_get_time();
+        while (streamPendingFrames())
         {
-            valueFifo.enqueue(EKG[index]);
-        }
-        else
-        {
-            valueFifo.enqueue(ARY[index]);
         }
+        metricsStageTime(STAGE_ENCODE, esp_timer_get_time() - start);
     }
-    else
+}
+
+/**
+ * @brief Reprograms the sample timer, doing nothing if the period did not change.
+ * 
+ * @param periodUs New interval between data points in microseconds.
+ */
+void setSamplePeriod(uint32_t periodUs)
+{
+    if (periodUs == samplePeriodUs)
     {
-        valueFifo.enqueue(deadPoints[index]);
+        return;
     }
-
-    return true;
+    samplePeriodUs = periodUs;
+    esp_timer_stop(sampleTimer); // Fails harmlessly if the timer is not running yet
+    esp_timer_start_periodic(sampleTimer, periodUs);
 }
 
 /**
- * @brief Debounces button presses and toggles a boolean variable.
+ * @brief Starts or stops the generator as viewers come and go, see IdleMode.h.
  * 
- * @param pin Pin number for the button.
- * @param buttonState Reference to the current debounced state of the button.
- * @param lastButtonState Reference to the last read state of the button.
- * @param lastDebounceTime Reference to the last time the button state changed.
- * @param toggleVariable Pointer to the boolean variable to toggle.
+ * Stopping the sample timer leaves the producer and stream tasks blocked, and the input task is paused
+ * with them since only the generator reads the knobs. Scenarios and button presses wait with them and
+ * carry on from where they were.
+ * 
+ * @param streaming true to run at SYNTH_SAMPLE_RATE again, false to stop.
  */
-void debounceAndToggle(int pin, bool &buttonState, bool &lastButtonState, unsigned long &lastDebounceTime, bool *toggleVariable)
+void setStreaming(bool streaming)
 {
-    int reading = digitalRead(pin); // Read the current state of the button
-
-    // If the button state has changed, reset the debouncing timer
-    if (reading != lastButtonState)
+    if (streaming)
     {
-        lastDebounceTime = millis();
+        metricsTimerRestart();
+        setInputSampling(true);
+        esp_timer_start_periodic(sampleTimer, samplePeriodUs);
+        xTaskNotifyGive(streamTaskHandle); // Back on its batch interval now rather than after a full batch
     }
-
-    // If the current time is more than debounceDelay milliseconds since the button state last changed...
-    if ((millis() - lastDebounceTime) > debounceDelay)
+    else
     {
-        // and if the button state has changed...
-        if (reading != buttonState)
-        {
-            buttonState = reading;
-
-            // Only toggle the boolean value if the new button state is LOW (pressed)
-            if (buttonState == LOW)
-            {
-                *toggleVariable = !(*toggleVariable); // Toggle the boolean variable
-            }
-        }
+        esp_timer_stop(sampleTimer);
+        setInputSampling(false);
     }
-
-    lastButtonState = reading; // Save the reading for next time
 }
 
 /**
@@ -184,51 +335,84 @@ void debounceAndToggle(int pin, bool &buttonState, bool &lastButtonState, unsign
 void setup()
 {
 	Serial.begin(115200);
+	// Each memoryMarkStage() charges the heap taken since the previous one to its subsystem, see GET /api/memory
+	memoryMarkStage("boot");
 
 	// Initialize SPIFFS
 	initSPIFFS();
+	memoryMarkStage("spiffs");
 
-	// Read network settings from SPIFFS
-	String ssid = readFile(SPIFFS, "/ssid.txt");
-	String password = readFile(SPIFFS, "/pass.txt");
-	String ip = readFile(SPIFFS, "/ip.txt");
-	String gateway = readFile(SPIFFS, "/gateway.txt");
+	// Read network settings from SPIFFS, one record kept in RAM
+	loadNetworkConfig();
 
-	// Initialize WiFi connection
-	initWiFi(ssid, password, ip, gateway);
+	// Start the WiFi connection in the background; the server and the generator do not wait for it
+	initWiFi();
+	memoryMarkStage("wifi");
 
 	pinMode(AMP_STICK_PIN, INPUT);
 	pinMode(BPM_STICK_PIN, INPUT);
 
-	pinMode(ARY_SWITCH_PIN, INPUT_PULLUP);
-	pinMode(KLL_SWITCH_PIN, INPUT_PULLUP);
+	// The buttons interrupt on their edges; presses are applied by the producer at the next beat
+	aryButton.begin();
+	kllButton.begin();
+	memoryMarkStage("buttons");
 
 	// Start the web server
 	startServer();
-
-	ITimer0.attachInterruptInterval(TIMER0_INTERVAL_MS * 1000, TimerHandler0);
+	memoryMarkStage("server");
+
+	// Read the knobs in the background so loop() never waits on the ADC
+	AnalogKnob *knobs[] = { &bpmKnob, &ampKnob };
+	startInputSampling(knobs, sizeof(knobs) / sizeof(knobs[0]));
+	memoryMarkStage("input");
+
+#if MULTICAST_STREAM
+	// One datagram per batch to the group, for viewers beyond the TCP client limits; mDNS advertises it once connected
+	multicastStream.begin();
+	memoryMarkStage("multicast");
+#endif
+
+	// Extra rhythms are read in place from their flash partition; without one only the built-ins play
+	wavePack.begin();
+	memoryMarkStage("wavepack");
+
+	// Start the sample producer at the fixed synthesis rate; it follows the BPM knob on its own
+	// The stream task drains what the producer queues; it must exist before the producer can wake it
+	xTaskCreatePinnedToCore(streamTask, "stream", STREAM_TASK_STACK, NULL, STREAM_TASK_PRIORITY, &streamTaskHandle, STREAM_TASK_CORE);
+	xTaskCreatePinnedToCore(sampleProducerTask, "producer", PRODUCER_TASK_STACK, NULL, PRODUCER_TASK_PRIORITY, &producerTaskHandle, PRODUCER_TASK_CORE);
+	memoryTrackTask("stream", STREAM_TASK_STACK);
+	memoryTrackTask("producer", PRODUCER_TASK_STACK);
+	esp_timer_create_args_t timerArgs = {};
+	timerArgs.callback = onSampleTimer;
+	timerArgs.name = "sample";
+	esp_timer_create(&timerArgs, &sampleTimer);
+	channelSynth[CHANNEL_RESP].setBpm(RESP_RATE);
+	setSamplePeriod(1000000UL / SYNTH_SAMPLE_RATE);
+	memoryMarkStage("generator");
+
+	// With nobody watching the generator stops and the radio sleeps; the first viewer restarts both
+	idleBegin(setStreaming);
 }
 
 /**
  * @brief Main loop function, called repeatedly.
+ * 
+ * Blocks between passes instead of spinning: LOOP_ACTIVE_WAIT_MS while streaming, LOOP_IDLE_WAIT_MS
+ * while idle, or until a joining viewer wakes it.
  */
 void loop()
 {
-
-	amp = map(analogRead(AMP_STICK_PIN), 0, 4095, 10, 100) / 100.0;
-	bpm = map(analogRead(BPM_STICK_PIN), 0, 4095, 40, 220);
-	delayMillis = map(analogRead(BPM_STICK_PIN), 0, 4095, 9, 48);
-
-	if (!valueFifo.isEmpty())
+	idleLoopWait(wifiPortalActive());
+#if ALLOC_REPORT_INTERVAL_MS
+	if (millis() - lastAllocReportTime >= ALLOC_REPORT_INTERVAL_MS)
 	{
-		uint8_t val;
-		if (valueFifo.dequeue(val))
-		{
-			notifyClients(val * amp);
-		}
+		lastAllocReportTime = millis();
+		Serial.printf("SSE message allocations since boot: %u\r\n", notifyAllocationCount());
 	}
+#endif
 
-	debounceAndToggle(ARY_SWITCH_PIN, buttonState, lastButtonState, lastDebounceTime, &isEKG);
-
-	debounceAndToggle(KLL_SWITCH_PIN, buttonStateKLL, lastButtonStateKLL, lastDebounceTimeKLL, &isAlive);
+	serviceWiFi();
+	idleService(events.count() + ws.count() + (multicastStream.active() ? 1 : 0)); // Multicast viewers cannot be counted
+	metricsLoopTick();
+	soakReportTick(sampleSeq.load(std::memory_order_relaxed), valueFifo.overruns());
 }